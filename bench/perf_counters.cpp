@@ -0,0 +1,161 @@
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#endif
+
+PerfSample operator-(const PerfSample& end, const PerfSample& begin) {
+    PerfSample result;
+    for (int i = 0; i < PerfEventCount; ++i) {
+        result.valid[i] = end.valid[i] && begin.valid[i];
+        result.values[i] = result.valid[i] && end.values[i] >= begin.values[i] ? end.values[i] - begin.values[i] : 0;
+    }
+    return result;
+}
+
+PerfSample& operator+=(PerfSample& total, const PerfSample& delta) {
+    for (int i = 0; i < PerfEventCount; ++i) {
+        total.values[i] += delta.values[i];
+        total.valid[i] = delta.valid[i];
+    }
+    return total;
+}
+
+const char* perf_event_name(PerfEvent event) {
+    switch (event) {
+    case PerfCycles:
+        return "cycles";
+    case PerfInstructions:
+        return "instructions";
+    case PerfL1DMisses:
+        return "l1d_misses";
+    case PerfLLCMisses:
+        return "llc_misses";
+    case PerfBranchMisses:
+        return "branch_misses";
+    case PerfEventCount:
+        break;
+    }
+    return "unknown";
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+#ifdef __linux__
+namespace {
+void describe(PerfEvent event, perf_event_attr& attr) {
+    switch (event) {
+    case PerfCycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PerfInstructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PerfL1DMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PerfLLCMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PerfBranchMisses:
+    case PerfEventCount:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+}
+
+std::vector<int> process_threads() {
+    std::vector<int> tids;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return {static_cast<int>(syscall(SYS_gettid))};
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            tids.push_back(std::atoi(entry->d_name));
+        }
+    }
+    closedir(dir);
+    return tids;
+}
+}
+
+bool PerfCounters::open() {
+    close();
+    std::array<bool, PerfEventCount> opened{};
+    for (int tid : process_threads()) {
+        for (int i = 0; i < PerfEventCount; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            describe(static_cast<PerfEvent>(i), attr);
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+            if (fd >= 0) {
+                counters_.push_back({fd, static_cast<PerfEvent>(i)});
+                opened[i] = true;
+            }
+        }
+    }
+    available_ = opened[PerfCycles] || opened[PerfInstructions];
+    if (!available_) {
+        close();
+    }
+    return available_;
+}
+
+void PerfCounters::close() {
+    for (const auto& counter : counters_) {
+        ::close(counter.fd);
+    }
+    counters_.clear();
+    available_ = false;
+}
+
+PerfSample PerfCounters::read() const {
+    PerfSample sample;
+    for (const auto& counter : counters_) {
+        uint64_t data[3] = {};
+        if (::read(counter.fd, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) {
+            continue;
+        }
+        uint64_t value = data[0];
+        // Scale up when the kernel had to multiplex this counter.
+        if (data[2] > 0 && data[2] < data[1]) {
+            value = static_cast<uint64_t>(static_cast<double>(value) * data[1] / data[2]);
+        }
+        sample.values[counter.event] += value;
+        sample.valid[counter.event] = true;
+    }
+    return sample;
+}
+#else
+bool PerfCounters::open() {
+    return false;
+}
+
+void PerfCounters::close() {
+    available_ = false;
+}
+
+PerfSample PerfCounters::read() const {
+    return {};
+}
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+enum PerfEvent {
+    PerfCycles,
+    PerfInstructions,
+    PerfL1DMisses,
+    PerfLLCMisses,
+    PerfBranchMisses,
+    PerfEventCount,
+};
+
+struct PerfSample {
+    std::array<uint64_t, PerfEventCount> values{};
+    std::array<bool, PerfEventCount> valid{};
+
+    double ipc() const {
+        return valid[PerfCycles] && valid[PerfInstructions] && values[PerfCycles] > 0
+                   ? static_cast<double>(values[PerfInstructions]) / static_cast<double>(values[PerfCycles])
+                   : 0.0;
+    }
+};
+
+PerfSample operator-(const PerfSample& end, const PerfSample& begin);
+PerfSample& operator+=(PerfSample& total, const PerfSample& delta);
+
+const char* perf_event_name(PerfEvent event);
+
+// Hardware counters for every thread of the process via perf_event_open(2).
+// Open after all worker threads exist; threads created later are not counted.
+// Events the kernel or hypervisor refuses are marked invalid, and when none
+// can be opened available() is false and callers fall back to wall time.
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool open();
+    void close();
+    bool available() const { return available_; }
+    PerfSample read() const;
+
+private:
+    struct Counter {
+        int fd = -1;
+        PerfEvent event = PerfCycles;
+    };
+
+    std::vector<Counter> counters_;
+    bool available_ = false;
+};
@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "perf_counters.hpp"
+#include "image.hpp"
+#include "job_system.hpp"
+#include "model.hpp"
+#include "rasterizer.hpp"
+#include "render_stats.hpp"
+#include "scene_generator.hpp"
+#include "scene_setup.hpp"
+#include "shader.hpp"
+
+namespace {
+struct SceneSource {
+    std::string name;
+    bool synthetic = false;
+};
+
+struct BenchOptions {
+    std::vector<SceneSource> scenes;
+    std::vector<int> resolutions = {256, 512, 1024, 2048, 4096, 8192};
+    std::vector<int> threads;
+    std::vector<FramebufferLayout> layouts = {FramebufferLayout::Linear};
+    std::vector<DepthFormat> depth_formats = {DepthFormat::Float32};
+    std::vector<int> samples = {1};
+    std::vector<ShadingRateMode> shading_rates = {ShadingRateMode::Full};
+    std::vector<DrawOrder> draw_orders = {DrawOrder::Submission};
+    std::vector<int> prepass = {0};
+    std::vector<int> occlusion = {0};
+    std::vector<ClusterCulling> cluster_culling = {ClusterCulling::Off};
+    float zoom = 1.f;
+    // Renders each model as a Scene of this many instances when positive.
+    int instances = 0;
+    int warmup = 1;
+    int trials = 5;
+    bool encode = true;
+    bool perf = false;
+    std::string json_path;
+};
+
+enum Stage { Load, Clear, Vertex, Setup, Raster, Shade, Encode, Total, StageCount };
+
+const char* const kStageNames[StageCount] = {
+    "load", "clear", "vertex", "setup", "raster", "shade", "encode", "total",
+};
+
+// Counter stages are the RenderStage values followed by PNG encode.
+constexpr int kCounterStageCount = kRenderStageCount + 1;
+constexpr int kEncodeCounterStage = kRenderStageCount;
+
+const char* const kCounterStageNames[kCounterStageCount] = {
+    "clear", "vertex", "setup", "raster", "encode",
+};
+
+struct Summary {
+    double median = 0.0;
+    double p90 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+};
+
+// Rasterizer settings swept per resolution and thread count.
+struct RasterVariant {
+    FramebufferLayout layout = FramebufferLayout::Linear;
+    DepthFormat depth_format = DepthFormat::Float32;
+    int samples = 1;
+    ShadingRateMode shading_rate = ShadingRateMode::Full;
+    DrawOrder draw_order = DrawOrder::Submission;
+    bool depth_prepass = false;
+    bool occlusion_culling = false;
+    ClusterCulling cluster_culling = ClusterCulling::Off;
+};
+
+struct BenchResult {
+    std::string model;
+    int width = 0;
+    int height = 0;
+    int threads = 0;
+    RasterVariant variant;
+    Summary stages[StageCount];
+    RenderStats last;
+    bool has_counters = false;
+    std::array<PerfSample, kCounterStageCount> counters{};
+};
+
+class CounterObserver : public IStageObserver {
+public:
+    explicit CounterObserver(const PerfCounters& counters) : counters_(counters) {}
+
+    void stage_begin(RenderStage) override { begin_ = counters_.read(); }
+    void stage_end(RenderStage stage) override { add(static_cast<int>(stage), counters_.read() - begin_); }
+
+    void add(int stage, const PerfSample& delta) {
+        if (recording_) {
+            totals_[static_cast<size_t>(stage)] += delta;
+        }
+    }
+
+    void set_recording(bool recording) { recording_ = recording; }
+    const std::array<PerfSample, kCounterStageCount>& totals() const { return totals_; }
+
+private:
+    const PerfCounters& counters_;
+    PerfSample begin_;
+    bool recording_ = false;
+    std::array<PerfSample, kCounterStageCount> totals_{};
+};
+
+std::vector<int> parse_int_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(std::stoi(item));
+        }
+    }
+    if (values.empty()) {
+        throw std::runtime_error("Expected a comma-separated list, got: " + text);
+    }
+    return values;
+}
+
+// Splits a comma-separated list and parses each item, naming the item kind
+// what in errors.
+template <typename T>
+std::vector<T> parse_list(const std::string& text, bool (*parse)(const std::string&, T&), const char* what) {
+    std::vector<T> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        T value;
+        if (!parse(item, value)) {
+            throw std::runtime_error(std::string("Unknown ") + what + ": " + item);
+        }
+        values.push_back(value);
+    }
+    if (values.empty()) {
+        throw std::runtime_error(std::string("Expected a comma-separated list of ") + what + "s, got: " + text);
+    }
+    return values;
+}
+
+BenchOptions parse_options(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--model") {
+            options.scenes.push_back({value(), false});
+        } else if (arg == "--synthetic") {
+            options.scenes.push_back({value(), true});
+        } else if (arg == "--resolutions") {
+            options.resolutions = parse_int_list(value());
+        } else if (arg == "--threads") {
+            options.threads = parse_int_list(value());
+        } else if (arg == "--layouts") {
+            options.layouts = parse_list(value(), parse_framebuffer_layout, "framebuffer layout");
+        } else if (arg == "--depth-formats") {
+            options.depth_formats = parse_list(value(), parse_depth_format, "depth format");
+        } else if (arg == "--samples") {
+            options.samples = parse_int_list(value());
+        } else if (arg == "--shading-rates") {
+            options.shading_rates = parse_list(value(), parse_shading_rate_mode, "shading rate");
+        } else if (arg == "--draw-orders") {
+            options.draw_orders = parse_list(value(), parse_draw_order, "draw order");
+        } else if (arg == "--prepass") {
+            options.prepass = parse_int_list(value());
+        } else if (arg == "--occlusion") {
+            options.occlusion = parse_int_list(value());
+        } else if (arg == "--cluster-culling") {
+            options.cluster_culling = parse_list(value(), parse_cluster_culling, "cluster culling mode");
+        } else if (arg == "--zoom") {
+            options.zoom = std::stof(value());
+            if (!(options.zoom > 0.f)) {
+                throw std::runtime_error("--zoom must be positive");
+            }
+        } else if (arg == "--instances") {
+            options.instances = std::stoi(value());
+            if (options.instances < 0) {
+                throw std::runtime_error("--instances must not be negative");
+            }
+        } else if (arg == "--warmup") {
+            options.warmup = std::stoi(value());
+        } else if (arg == "--trials") {
+            options.trials = std::max(1, std::stoi(value()));
+        } else if (arg == "--no-encode") {
+            options.encode = false;
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else if (arg == "--json") {
+            options.json_path = value();
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+    if (options.scenes.empty()) {
+        options.scenes.push_back({"models/african_head.obj", false});
+    }
+    if (options.threads.empty()) {
+        int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        options.threads.push_back(1);
+        if (hardware > 1) {
+            options.threads.push_back(hardware);
+        }
+    }
+    return options;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    double rank = p * static_cast<double>(values.size() - 1);
+    size_t lower = static_cast<size_t>(rank);
+    size_t upper = std::min(lower + 1, values.size() - 1);
+    double frac = rank - static_cast<double>(lower);
+    return values[lower] * (1.0 - frac) + values[upper] * frac;
+}
+
+Summary summarize(const std::vector<double>& values) {
+    Summary summary;
+    if (values.empty()) {
+        return summary;
+    }
+    summary.median = percentile(values, 0.5);
+    summary.p90 = percentile(values, 0.9);
+    summary.min = *std::min_element(values.begin(), values.end());
+    summary.max = *std::max_element(values.begin(), values.end());
+    return summary;
+}
+
+Model load_scene(const SceneSource& scene) {
+    return scene.synthetic ? make_synthetic(scene.name) : Model(scene.name);
+}
+
+// For synthetic scenes "load" is the generation time.
+std::vector<double> time_model_load(const SceneSource& scene, const BenchOptions& options) {
+    std::vector<double> samples;
+    for (int i = 0; i < options.warmup + options.trials; ++i) {
+        auto start = StatsClock::now();
+        Model model = load_scene(scene);
+        double ms = elapsed_ms(start, StatsClock::now());
+        if (i >= options.warmup) {
+            samples.push_back(ms);
+        }
+    }
+    return samples;
+}
+
+BenchResult run_config(const std::string& name,
+                       const Model& model,
+                       const std::vector<double>& load_samples,
+                       int resolution,
+                       int threads,
+                       const RasterVariant& variant,
+                       const BenchOptions& options) {
+    JobSystemConfig config;
+    config.worker_count = threads;
+    JobSystem jobs(config);
+    Rasterizer raster(resolution, resolution);
+    raster.set_job_system(&jobs);
+    raster.set_framebuffer_layout(variant.layout);
+    raster.set_depth_format(variant.depth_format);
+    raster.set_sample_count(variant.samples);
+    ShadingRateConfig shading_rate;
+    shading_rate.mode = variant.shading_rate;
+    raster.set_shading_rate(shading_rate);
+    raster.set_draw_order(variant.draw_order);
+    raster.set_depth_prepass(variant.depth_prepass);
+    OcclusionCullingConfig occlusion;
+    occlusion.enabled = variant.occlusion_culling;
+    raster.set_occlusion_culling(occlusion);
+    raster.set_cluster_culling(variant.cluster_culling);
+    PhongShader shader;
+    bool reversed_z = variant.depth_format == DepthFormat::ReversedFloat32;
+    frame_model(shader, model, resolution, resolution, options.zoom, reversed_z);
+    Scene scene;
+    if (options.instances > 0) {
+        frame_instances(scene, model, options.instances, resolution, resolution, options.zoom, reversed_z);
+    }
+
+    PerfCounters counters;
+    CounterObserver observer(counters);
+    if (options.perf && counters.open()) {
+        raster.set_stage_observer(&observer);
+    }
+
+    std::vector<double> samples[StageCount];
+    std::vector<uint8_t> png;
+    BenchResult result;
+    for (int i = 0; i < options.warmup + options.trials; ++i) {
+        observer.set_recording(i >= options.warmup);
+        RenderStats stats = options.instances > 0 ? raster.render(scene) : raster.render(model, shader);
+        if (options.encode) {
+            PerfSample encode_begin = counters.read();
+            auto start = StatsClock::now();
+            if (!raster.image().encode_png(png)) {
+                throw std::runtime_error("PNG encode failed");
+            }
+            stats.encode_ms = elapsed_ms(start, StatsClock::now());
+            if (counters.available()) {
+                observer.add(kEncodeCounterStage, counters.read() - encode_begin);
+            }
+        }
+        if (i < options.warmup) {
+            continue;
+        }
+        samples[Clear].push_back(stats.clear_ms);
+        samples[Vertex].push_back(stats.vertex_ms);
+        samples[Setup].push_back(stats.setup_ms);
+        samples[Raster].push_back(stats.raster_ms);
+        samples[Shade].push_back(stats.shade_ms);
+        samples[Encode].push_back(stats.encode_ms);
+        samples[Total].push_back(stats.total_ms + stats.encode_ms);
+        result.last = stats;
+    }
+    samples[Load] = load_samples;
+
+    result.model = options.instances > 0 ? name + " x" + std::to_string(options.instances) : name;
+    result.width = resolution;
+    result.height = resolution;
+    result.threads = jobs.worker_count();
+    result.variant = variant;
+    for (int stage = 0; stage < StageCount; ++stage) {
+        result.stages[stage] = summarize(samples[stage]);
+    }
+    if (counters.available()) {
+        result.has_counters = true;
+        result.counters = observer.totals();
+        for (auto& sample : result.counters) {
+            for (auto& value : sample.values) {
+                value /= static_cast<uint64_t>(options.trials);
+            }
+        }
+    }
+    return result;
+}
+
+// Depth tests per microsecond of raster time, i.e. millions per second.
+double depth_test_rate(const BenchResult& result) {
+    double raster_ms = result.stages[Raster].median;
+    return raster_ms > 0.0 ? static_cast<double>(result.last.depth_tests) / (raster_ms * 1000.0) : 0.0;
+}
+
+// Vertex and setup costs scale with triangles, raster/encode with pixels.
+double counter_scale(const BenchResult& result, int stage) {
+    if (stage == static_cast<int>(RenderStage::Vertex) || stage == static_cast<int>(RenderStage::Setup)) {
+        return static_cast<double>(std::max<uint64_t>(1, result.last.triangles_submitted));
+    }
+    return static_cast<double>(result.width) * result.height;
+}
+
+const char* counter_unit(int stage) {
+    return stage == static_cast<int>(RenderStage::Vertex) || stage == static_cast<int>(RenderStage::Setup) ? "tri" : "px";
+}
+
+void print_header() {
+    std::cout << std::left << std::setw(28) << "model" << std::right
+              << std::setw(7) << "res" << std::setw(5) << "thr" << std::setw(8) << "layout"
+              << std::setw(9) << "depth" << std::setw(5) << "spp" << std::setw(9) << "rate"
+              << std::setw(15) << "order" << std::setw(5) << "zpp" << std::setw(9) << "occluded"
+              << std::setw(14) << "clusters";
+    for (int stage = 0; stage < StageCount; ++stage) {
+        std::cout << std::setw(10) << kStageNames[stage];
+    }
+    std::cout << std::setw(10) << "p90" << std::setw(10) << "Mtest/s" << std::setw(10) << "overdraw" << "\n";
+}
+
+void print_result(const BenchResult& result) {
+    std::string model = result.model.size() > 27 ? result.model.substr(result.model.size() - 27) : result.model;
+    std::cout << std::left << std::setw(28) << model << std::right
+              << std::setw(7) << result.width << std::setw(5) << result.threads
+              << std::setw(8) << framebuffer_layout_name(result.variant.layout)
+              << std::setw(9) << depth_format_name(result.variant.depth_format)
+              << std::setw(5) << result.variant.samples
+              << std::setw(9) << shading_rate_mode_name(result.variant.shading_rate)
+              << std::setw(15) << draw_order_name(result.variant.draw_order)
+              << std::setw(5) << (result.variant.depth_prepass ? "on" : "off")
+              << std::setw(9) << (result.variant.occlusion_culling ? std::to_string(result.last.objects_occluded) : "off")
+              << std::setw(14) << cluster_culling_name(result.variant.cluster_culling)
+              << std::fixed << std::setprecision(2);
+    for (int stage = 0; stage < StageCount; ++stage) {
+        std::cout << std::setw(10) << result.stages[stage].median;
+    }
+    std::cout << std::setw(10) << result.stages[Total].p90 << std::setw(10) << depth_test_rate(result)
+              << std::setw(10) << result.last.overdraw() << std::endl;
+    if (!result.has_counters) {
+        return;
+    }
+    for (int stage = 0; stage < kCounterStageCount; ++stage) {
+        const PerfSample& sample = result.counters[static_cast<size_t>(stage)];
+        double scale = counter_scale(result, stage);
+        std::cout << "    " << std::left << std::setw(8) << kCounterStageNames[stage] << std::right
+                  << " ipc " << std::setprecision(2) << sample.ipc()
+                  << "  l1d/" << counter_unit(stage) << " " << std::setprecision(4)
+                  << sample.values[PerfL1DMisses] / scale
+                  << "  llc/" << counter_unit(stage) << " " << sample.values[PerfLLCMisses] / scale
+                  << "  br-miss/" << counter_unit(stage) << " " << sample.values[PerfBranchMisses] / scale
+                  << std::endl;
+    }
+}
+
+void write_json(const std::string& path, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Failed to open JSON output: " + path);
+    }
+    out << std::fixed << std::setprecision(4);
+    out << "{\"benchmark\":\"renderer_bench\",\"hardware_threads\":" << std::thread::hardware_concurrency()
+        << ",\"warmup\":" << options.warmup << ",\"trials\":" << options.trials << ",\"results\":[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& result = results[i];
+        out << "{\"model\":\"" << result.model << "\",\"width\":" << result.width
+            << ",\"height\":" << result.height << ",\"threads\":" << result.threads << ",\"layout\":\""
+            << framebuffer_layout_name(result.variant.layout) << "\",\"depth_format\":\""
+            << depth_format_name(result.variant.depth_format) << "\",\"samples\":" << result.variant.samples
+            << ",\"shading_rate\":\"" << shading_rate_mode_name(result.variant.shading_rate) << "\""
+            << ",\"draw_order\":\"" << draw_order_name(result.variant.draw_order) << "\""
+            << ",\"depth_prepass\":" << (result.variant.depth_prepass ? "true" : "false")
+            << ",\"occlusion_culling\":" << (result.variant.occlusion_culling ? "true" : "false")
+            << ",\"cluster_culling\":\"" << cluster_culling_name(result.variant.cluster_culling) << "\""
+            << ",\"depth_tests_per_us\":" << depth_test_rate(result)
+            << ",\"stages\":{";
+        for (int stage = 0; stage < StageCount; ++stage) {
+            const Summary& summary = result.stages[stage];
+            out << (stage ? "," : "") << "\"" << kStageNames[stage] << "\":{\"median\":" << summary.median
+                << ",\"p90\":" << summary.p90 << ",\"min\":" << summary.min << ",\"max\":" << summary.max << "}";
+        }
+        out << "},\"stats\":" << result.last.to_json();
+        if (result.has_counters) {
+            out << ",\"counters\":{";
+            for (int stage = 0; stage < kCounterStageCount; ++stage) {
+                const PerfSample& sample = result.counters[static_cast<size_t>(stage)];
+                out << (stage ? "," : "") << "\"" << kCounterStageNames[stage] << "\":{";
+                bool first = true;
+                for (int event = 0; event < PerfEventCount; ++event) {
+                    if (sample.valid[event]) {
+                        out << (first ? "" : ",") << "\"" << perf_event_name(static_cast<PerfEvent>(event))
+                            << "\":" << sample.values[event];
+                        first = false;
+                    }
+                }
+                out << (first ? "" : ",") << "\"ipc\":" << sample.ipc()
+                    << ",\"unit\":\"" << counter_unit(stage) << "\",\"units\":" << counter_scale(result, stage) << "}";
+            }
+            out << "}";
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]}\n";
+}
+}
+
+int main(int argc, char** argv) {
+    try {
+        BenchOptions options = parse_options(argc, argv);
+        if (options.perf) {
+            PerfCounters probe;
+            if (!probe.open()) {
+                std::cerr << "perf_event_open counters unavailable; reporting wall time only" << std::endl;
+            }
+        }
+        std::vector<RasterVariant> variants;
+        for (FramebufferLayout layout : options.layouts) {
+            for (DepthFormat depth_format : options.depth_formats) {
+                for (int samples : options.samples) {
+                    for (ShadingRateMode shading_rate : options.shading_rates) {
+                        for (DrawOrder draw_order : options.draw_orders) {
+                            for (int prepass : options.prepass) {
+                                for (int occlusion : options.occlusion) {
+                                    for (ClusterCulling clusters : options.cluster_culling) {
+                                        variants.push_back({layout, depth_format, samples, shading_rate, draw_order,
+                                                            prepass != 0, occlusion != 0, clusters});
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        std::vector<BenchResult> results;
+        print_header();
+        for (const auto& scene : options.scenes) {
+            std::vector<double> load_samples = time_model_load(scene, options);
+            Model model = load_scene(scene);
+            for (int resolution : options.resolutions) {
+                for (int threads : options.threads) {
+                    for (const RasterVariant& variant : variants) {
+                        results.push_back(
+                            run_config(scene.name, model, load_samples, resolution, threads, variant, options));
+                        print_result(results.back());
+                    }
+                }
+            }
+        }
+        if (!options.json_path.empty()) {
+            write_json(options.json_path, options, results);
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
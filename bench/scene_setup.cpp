@@ -0,0 +1,78 @@
+#include "scene_setup.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "camera.hpp"
+
+namespace {
+void frame_bounds(PhongShader& shader, const Aabb& bounds, int width, int height, float zoom, bool reversed_z) {
+    Vec3f center = bounds.center();
+    float radius = std::max(1e-3f, length(bounds.max - bounds.min) * 0.5f);
+
+    Camera camera(center + Vec3f{0.f, radius * 0.3f, radius * 2.6f},
+                  center,
+                  {0.f, 1.f, 0.f},
+                  45.f / zoom,
+                  static_cast<float>(width) / static_cast<float>(height),
+                  radius * 0.05f,
+                  radius * 10.f);
+    camera.set_reversed_z(reversed_z);
+
+    shader.set_matrices(Mat4f::identity(), camera.view_matrix(), camera.projection_matrix());
+    shader.set_light_direction(normalize(Vec3f{0.4f, 0.8f, 0.1f}));
+    shader.set_light_color({1.f, 0.96f, 0.9f});
+    shader.set_fill_light(normalize(Vec3f{-0.3f, 0.4f, -0.2f}), {0.45f, 0.5f, 0.6f});
+    shader.set_view_position(camera.position());
+    shader.set_material({0.15f, 0.1f, 0.08f},
+                        {0.7f, 0.5f, 0.45f},
+                        {0.4f, 0.35f, 0.3f},
+                        42.f);
+    shader.set_exposure(1.8f);
+}
+}
+
+void frame_model(PhongShader& shader, const Model& model, int width, int height, float zoom, bool reversed_z) {
+    frame_bounds(shader, model.bounds(), width, height, zoom, reversed_z);
+}
+
+void frame_instances(Scene& scene,
+                     const Model& model,
+                     int count,
+                     int width,
+                     int height,
+                     float zoom,
+                     bool reversed_z) {
+    const Aabb& bounds = model.bounds();
+    Vec3f size = bounds.max - bounds.min;
+    float spacing = std::max({size.x, size.y, 1e-3f}) * 1.1f;
+    int columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count)))));
+    int rows = (count + columns - 1) / columns;
+
+    std::array<std::vector<Mat4f>, 4> instances;
+    Aabb grid = bounds;
+    for (int i = 0; i < count; ++i) {
+        Vec3f offset{(static_cast<float>(i % columns) - static_cast<float>(columns - 1) * 0.5f) * spacing,
+                     (static_cast<float>(rows - 1) * 0.5f - static_cast<float>(i / columns)) * spacing,
+                     0.f};
+        instances[static_cast<size_t>(i) % instances.size()].push_back(Mat4f::translation(offset));
+        grid.extend(bounds.min + offset);
+        grid.extend(bounds.max + offset);
+    }
+    frame_bounds(scene.shading(), grid, width, height, zoom, reversed_z);
+
+    Material base = scene.shading().material();
+    const std::array<Material, 4> materials = {
+        base,
+        Material{{0.06f, 0.1f, 0.14f}, {0.35f, 0.5f, 0.7f}, base.specular, base.shininess},
+        Material{{0.08f, 0.12f, 0.06f}, {0.45f, 0.65f, 0.35f}, base.specular, base.shininess},
+        Material{{0.12f, 0.12f, 0.12f}, {0.6f, 0.6f, 0.6f}, {0.8f, 0.8f, 0.8f}, 96.f},
+    };
+    for (size_t k = 0; k < instances.size(); ++k) {
+        if (!instances[k].empty()) {
+            scene.add(model, std::move(instances[k]), materials[k]);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "model.hpp"
+#include "scene.hpp"
+#include "shader.hpp"
+
+// Frames the model's bounding sphere from slightly above and in front and
+// applies the driver's lighting and material. zoom divides the field of
+// view, leaving the outer parts of the model out of view. reversed_z selects
+// the reversed-Z projection DepthFormat::ReversedFloat32 needs.
+void frame_model(PhongShader& shader,
+                 const Model& model,
+                 int width,
+                 int height,
+                 float zoom = 1.f,
+                 bool reversed_z = false);
+
+// Lays out count instances of model in a square grid facing the camera,
+// spread over four draws with different materials, and frames the grid
+// like frame_model.
+void frame_instances(Scene& scene,
+                     const Model& model,
+                     int count,
+                     int width,
+                     int height,
+                     float zoom = 1.f,
+                     bool reversed_z = false);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "math.hpp"
+
+struct Aabb {
+    Vec3f min;
+    Vec3f max;
+
+    Vec3f center() const { return (min + max) * 0.5f; }
+    Vec3f extent() const { return (max - min) * 0.5f; }
+
+    void extend(const Vec3f& p) {
+        min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+        max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+    }
+};
+
+// Bounding spheres are centered on their box and reach the farthest point,
+// which is usually much tighter than the box's half diagonal.
+struct BoundingSphere {
+    Vec3f center;
+    float radius = 0.f;
+};
+
+// Box around box transformed by the affine m.
+inline Aabb transform_box(const Mat4f& m, const Aabb& box) {
+    Vec3f center = box.center();
+    Vec3f extent = box.extent();
+    Vec3f moved;
+    Vec3f reach;
+    for (int row = 0; row < 3; ++row) {
+        moved[row] = m[row][0] * center.x + m[row][1] * center.y + m[row][2] * center.z + m[row][3];
+        reach[row] = std::abs(m[row][0]) * extent.x + std::abs(m[row][1]) * extent.y + std::abs(m[row][2]) * extent.z;
+    }
+    return {moved - reach, moved + reach};
+}
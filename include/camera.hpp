@@ -1,5 +1,6 @@
 #pragma once
 
+#include "frustum.hpp"
 #include "math.hpp"
 
 class Camera {
@@ -23,8 +24,18 @@ public:
         return Mat4f::look_at(position_, target_, up_);
     }
 
+    // Reversed-Z projection, for DepthFormat::ReversedFloat32.
+    void set_reversed_z(bool reversed) { reversed_z_ = reversed; }
+    bool reversed_z() const { return reversed_z_; }
+
     Mat4f projection_matrix() const {
-        return Mat4f::perspective(radians(fov_), aspect_, near_, far_);
+        return reversed_z_ ? Mat4f::perspective_reversed(radians(fov_), aspect_, near_, far_)
+                           : Mat4f::perspective(radians(fov_), aspect_, near_, far_);
+    }
+
+    // World-space view volume.
+    Frustum frustum() const {
+        return Frustum::from_matrix(projection_matrix() * view_matrix(), reversed_z_);
     }
 
     const Vec3f& position() const { return position_; }
@@ -37,4 +48,5 @@ private:
     float aspect_ = 1.f;
     float near_ = 0.1f;
     float far_ = 100.f;
+    bool reversed_z_ = false;
 };
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+
+enum class DebugMode {
+    None,
+    DepthComplexity,
+};
+
+enum class ComplexityChannel {
+    Tested,
+    Passed,
+    Shaded,
+};
+
+// Per-pixel fragment counts gathered by Rasterizer in DebugMode::DepthComplexity.
+class DepthComplexity {
+public:
+    void reset(int width, int height);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    uint32_t* data(ComplexityChannel channel);
+    const std::vector<uint32_t>& channel(ComplexityChannel channel) const;
+
+    uint32_t max_value(ComplexityChannel channel) const;
+    std::vector<uint64_t> histogram(ComplexityChannel channel) const;
+
+    // Maps counts to a black-blue-green-yellow-red ramp. A non-zero scale_max
+    // pins the top of the ramp so several views can share one scale.
+    Image heatmap(ComplexityChannel channel, uint32_t scale_max = 0) const;
+    bool write_heatmap_png(const std::string& path,
+                           ComplexityChannel channel,
+                           uint32_t scale_max = 0) const;
+    bool write_histogram_csv(const std::string& path) const;
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<uint32_t> tested_;
+    std::vector<uint32_t> passed_;
+    std::vector<uint32_t> shaded_;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator that hands out memory from a list of blocks. reset() keeps
+// the blocks, so after warmup a frame does no heap allocation at all.
+class LinearAllocator {
+public:
+    explicit LinearAllocator(size_t block_size = size_t{1} << 20);
+
+    void* allocate(size_t bytes, size_t alignment);
+    void reset();
+
+    template <typename T>
+    T* allocate_array(size_t count) {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    size_t used_bytes() const { return used_; }
+    size_t reserved_bytes() const { return reserved_; }
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size = 0;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_ = 0;
+    size_t offset_ = 0;
+    size_t used_ = 0;
+    size_t reserved_ = 0;
+};
+
+// Fixed-size chunk allocator with an intrusive free list.
+class PoolAllocator {
+public:
+    PoolAllocator(size_t chunk_size, size_t chunks_per_block);
+
+    void* allocate();
+    void release(void* chunk);
+    void reset();
+
+    size_t chunk_size() const { return chunk_size_; }
+    size_t live_chunks() const { return live_; }
+    size_t reserved_bytes() const { return blocks_.size() * chunk_size_ * chunks_per_block_; }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    size_t chunk_size_;
+    size_t chunks_per_block_;
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    size_t current_ = 0;
+    size_t next_chunk_ = 0;
+    FreeNode* free_list_ = nullptr;
+    size_t live_ = 0;
+};
+
+// frame_bytes and bin_chunks are what the current frame holds, which for a
+// scene rendered in several passes is the last pass. The peaks span every
+// frame and pass since the arena was created.
+struct FrameArenaStats {
+    size_t frame_bytes = 0;
+    size_t peak_frame_bytes = 0;
+    size_t reserved_bytes = 0;
+    size_t bin_chunks = 0;
+    size_t peak_bin_chunks = 0;
+};
+
+// Per-worker transient memory for one frame. Each worker only touches its own
+// allocators, so no locking is needed.
+class FrameArena {
+public:
+    FrameArena(size_t bin_chunk_size, int worker_count = 1);
+
+    void set_worker_count(int worker_count);
+    int worker_count() const { return static_cast<int>(workers_.size()); }
+    void begin_frame();
+    // Returns every bin chunk to its pool mid-frame, keeping the peak stats.
+    void reset_bins();
+
+    LinearAllocator& linear(int worker) { return workers_[static_cast<size_t>(worker)]->linear; }
+    PoolAllocator& bin_pool(int worker) { return workers_[static_cast<size_t>(worker)]->bins; }
+
+    FrameArenaStats stats() const;
+
+private:
+    struct WorkerArena {
+        explicit WorkerArena(size_t bin_chunk_size) : bins(bin_chunk_size, 1024) {}
+        LinearAllocator linear;
+        PoolAllocator bins;
+    };
+
+    size_t bin_chunk_size_;
+    std::vector<std::unique_ptr<WorkerArena>> workers_;
+    size_t peak_frame_bytes_ = 0;
+    size_t peak_bin_chunks_ = 0;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "bounds.hpp"
+#include "math.hpp"
+#include "simd.hpp"
+
+// The six planes of a view volume, each (n, d) with unit n pointing inward,
+// so n . p + d is the signed distance of p from the plane. Extracted from a
+// clip transform (projection * view * model), the planes live in the space
+// that transform takes its input in.
+//
+// Tests are conservative: a volume is only rejected when it is entirely
+// outside one plane. The batch tests run four volumes per Float4 and agree
+// exactly with the single-volume ones.
+struct Frustum {
+    enum Side { Left, Right, Bottom, Top, Near, Far };
+
+    std::array<Vec4f, 6> planes{};
+
+    // reversed_z: the transform has a reversed-Z projection, whose clip
+    // volume has 0 <= z <= w.
+    static Frustum from_matrix(const Mat4f& clip_transform, bool reversed_z = false);
+
+    bool intersects(const BoundingSphere& sphere) const;
+    bool intersects(const Aabb& box) const;
+
+    // visible[i] = intersects(get(i)) for i < count, where get returns a
+    // BoundingSphere (or an Aabb for intersects_boxes).
+    template <typename Get>
+    void intersects_spheres(size_t count, Get get, uint8_t* visible) const;
+    template <typename Get>
+    void intersects_boxes(size_t count, Get get, uint8_t* visible) const;
+};
+
+template <typename Get>
+void Frustum::intersects_spheres(size_t count, Get get, uint8_t* visible) const {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        std::array<float, 4> x;
+        std::array<float, 4> y;
+        std::array<float, 4> z;
+        std::array<float, 4> r;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            const BoundingSphere& sphere = get(i + lane);
+            x[lane] = sphere.center.x;
+            y[lane] = sphere.center.y;
+            z[lane] = sphere.center.z;
+            r[lane] = -sphere.radius;
+        }
+        Vec3f4 center{Float4::load(x), Float4::load(y), Float4::load(z)};
+        Float4 reach = Float4::load(r);
+        Float4 outside(0.f);
+        for (const Vec4f& plane : planes) {
+            Float4 distance = dot(center, splat(Vec3f{plane.x, plane.y, plane.z})) + Float4(plane.w);
+            outside = outside | (distance < reach);
+        }
+        uint32_t bits = lane_bits(outside);
+        for (size_t lane = 0; lane < 4; ++lane) {
+            visible[i + lane] = ((bits >> lane) & 1) == 0;
+        }
+    }
+    for (; i < count; ++i) {
+        visible[i] = intersects(get(i));
+    }
+}
+
+template <typename Get>
+void Frustum::intersects_boxes(size_t count, Get get, uint8_t* visible) const {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        std::array<float, 4> c[3];
+        std::array<float, 4> e[3];
+        for (size_t lane = 0; lane < 4; ++lane) {
+            const Aabb& box = get(i + lane);
+            Vec3f center = box.center();
+            Vec3f extent = box.extent();
+            for (int axis = 0; axis < 3; ++axis) {
+                c[axis][lane] = center[axis];
+                e[axis][lane] = extent[axis];
+            }
+        }
+        Vec3f4 center{Float4::load(c[0]), Float4::load(c[1]), Float4::load(c[2])};
+        Vec3f4 extent{Float4::load(e[0]), Float4::load(e[1]), Float4::load(e[2])};
+        Float4 outside(0.f);
+        for (const Vec4f& plane : planes) {
+            // The box corner farthest along the normal is extent * |n| ahead
+            // of the center.
+            Float4 distance = dot(center, splat(Vec3f{plane.x, plane.y, plane.z})) + Float4(plane.w);
+            Float4 reach = dot(extent, splat(Vec3f{std::abs(plane.x), std::abs(plane.y), std::abs(plane.z)}));
+            outside = outside | (distance + reach < Float4(0.f));
+        }
+        uint32_t bits = lane_bits(outside);
+        for (size_t lane = 0; lane < 4; ++lane) {
+            visible[i + lane] = ((bits >> lane) & 1) == 0;
+        }
+    }
+    for (; i < count; ++i) {
+        visible[i] = intersects(get(i));
+    }
+}
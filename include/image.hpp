@@ -6,19 +6,49 @@
 
 #include "math.hpp"
 
+// Consumer of finished RGB8 rows, fed top to bottom.
+class IRowSink {
+public:
+    virtual ~IRowSink() = default;
+    virtual bool write_rows(const uint8_t* rows, int count) = 0;
+};
+
 class Image {
 public:
     Image(int width, int height);
+    // Wraps caller-owned RGB8 memory (e.g. shared memory) without copying.
+    // The memory must outlive the view; copying a view makes an owned image.
+    static Image view(int width, int height, uint8_t* pixels);
+
+    Image(const Image& other);
+    Image(Image&& other) noexcept;
+    Image& operator=(const Image& other);
+    Image& operator=(Image&& other) noexcept;
 
     void clear(const Vec3f& color);
+    // Fills the half-open rectangle [x0, x1) x [y0, y1), clipped to the image.
+    void fill_rect(int x0, int y0, int x1, int y1, const Vec3f& color);
     void set_pixel(int x, int y, const Vec3f& color);
+    // Converts a linear [0, 1] color to the three bytes set_pixel stores.
+    static void pack_rgb(const Vec3f& color, uint8_t* out) {
+        out[0] = static_cast<uint8_t>(clamp(color.x, 0.f, 1.f) * 255.f);
+        out[1] = static_cast<uint8_t>(clamp(color.y, 0.f, 1.f) * 255.f);
+        out[2] = static_cast<uint8_t>(clamp(color.z, 0.f, 1.f) * 255.f);
+    }
+    // Copies src with its top-left corner at (x, y), clipped to this image.
+    void blit(const Image& src, int x, int y);
     bool write_png(const std::string& path) const;
+    bool encode_png(std::vector<uint8_t>& out) const;
 
     int width() const { return width_; }
     int height() const { return height_; }
+    const uint8_t* data() const { return data_; }
+    uint8_t* data() { return data_; }
+    size_t byte_size() const { return static_cast<size_t>(width_) * height_ * 3; }
 
 private:
     int width_ = 0;
     int height_ = 0;
-    std::vector<uint8_t> pixels_;
+    std::vector<uint8_t> storage_;
+    uint8_t* data_ = nullptr;
 };
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+struct JobSystemConfig {
+    // 0 selects std::thread::hardware_concurrency(). The calling thread counts
+    // as worker 0, so worker_count - 1 threads are spawned.
+    int worker_count = 0;
+    // Pins every worker, the calling thread included, to one CPU. The
+    // calling thread's previous affinity is restored on destruction.
+    bool pin_threads = false;
+    // CPU ids used for pinning, indexed by worker. Empty means the CPUs the
+    // constructing thread may run on, in order, so taskset and cpusets hold.
+    std::vector<int> cpu_ids;
+};
+
+struct WorkerStats {
+    uint64_t tasks_executed = 0;
+    uint64_t tasks_stolen = 0;
+    // Time inside tasks. A task that waits runs other tasks inline; their
+    // time is counted for them only, so busy time never exceeds wall time.
+    uint64_t busy_ns = 0;
+    uint64_t idle_ns = 0;
+    // CPU the worker is pinned to; -1 when pinning is off or failed, or
+    // before the worker thread has started.
+    int cpu = -1;
+};
+
+class JobSystem {
+public:
+    struct Task;
+    using TaskHandle = std::shared_ptr<Task>;
+    using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+    explicit JobSystem(JobSystemConfig config = {});
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    TaskHandle submit(std::function<void()> fn,
+                      const std::vector<TaskHandle>& dependencies = {});
+    void wait(const TaskHandle& task);
+    void wait_all(const std::vector<TaskHandle>& tasks);
+    void parallel_for(size_t begin, size_t end, size_t grain, const RangeFn& fn);
+
+    int worker_count() const { return static_cast<int>(workers_.size()); }
+    // Index of the calling thread inside this system; non-worker threads map to 0.
+    int current_worker() const;
+
+    std::vector<WorkerStats> worker_stats() const;
+    void reset_stats();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<TaskHandle> queue;
+        std::atomic<uint64_t> tasks_executed{0};
+        std::atomic<uint64_t> tasks_stolen{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> idle_ns{0};
+        std::atomic<int> cpu{-1};
+    };
+
+    void worker_main(int index);
+    void enqueue(TaskHandle task);
+    TaskHandle pop_task(int index);
+    bool run_one(int index);
+    void execute(int index, const TaskHandle& task);
+    // Pins the calling thread to worker index's CPU and records it in the
+    // worker's stats; returns false when pinning is unsupported or fails.
+    bool pin_current_thread(int index);
+
+    JobSystemConfig config_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    // CPUs the constructing thread could run on before it was pinned.
+    std::vector<int> caller_cpus_;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    std::atomic<int> queued_{0};
+    std::atomic<bool> stopping_{false};
+};
+
+struct JobSystem::Task {
+    std::function<void()> fn;
+    std::atomic<int> unresolved{1};
+    std::atomic<bool> finished{false};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::vector<TaskHandle> dependents;
+};
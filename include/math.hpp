@@ -170,6 +170,19 @@ struct Mat4f {
         return result;
     }
 
+    // Reversed-Z: clip z / w is 1 at the near plane and 0 at the far plane,
+    // so the depth buffer's float precision is spent on distant geometry.
+    static Mat4f perspective_reversed(float fov_y, float aspect, float z_near, float z_far) {
+        Mat4f result = {};
+        float f = 1.f / std::tan(fov_y * 0.5f);
+        result[0][0] = f / aspect;
+        result[1][1] = f;
+        result[2][2] = z_near / (z_far - z_near);
+        result[2][3] = (z_far * z_near) / (z_far - z_near);
+        result[3][2] = -1.f;
+        return result;
+    }
+
     static Mat4f look_at(const Vec3f& eye, const Vec3f& center, const Vec3f& up) {
         Vec3f f = normalize(center - eye);
         Vec3f s = normalize(cross(f, up));
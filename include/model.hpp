@@ -1,28 +1,96 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "bounds.hpp"
 #include "math.hpp"
 
+// A named run of consecutive faces, from an OBJ "o" or "g" statement.
+struct ModelObject {
+    std::string name;
+    size_t first_face = 0;
+    size_t face_count = 0;
+    // Object-space bounds of the faces' vertices.
+    Aabb bounds;
+    BoundingSphere sphere;
+    size_t first_meshlet = 0;
+    size_t meshlet_count = 0;
+};
+
+// A connected cluster of faces of one object, small enough to cull as a
+// unit: at most kMaxVertices distinct vertices and kMaxFaces faces.
+struct Meshlet {
+    static constexpr size_t kMaxVertices = 64;
+    static constexpr size_t kMaxFaces = 124;
+
+    // The meshlet's faces are meshlet_faces()[face_offset, + face_count).
+    size_t face_offset = 0;
+    size_t face_count = 0;
+    // Object-space bounds of the faces' vertices.
+    BoundingSphere sphere;
+    // Every face normal n has dot(n, cone_axis) >= sqrt(1 - cone_cutoff^2).
+    // The meshlet is back-facing from an eye e when
+    // dot(c - e, cone_axis) >= cone_cutoff * |c - e| + r for its sphere (c, r).
+    // A cutoff of 1 never culls.
+    Vec3f cone_axis;
+    float cone_cutoff = 1.f;
+};
+
 class Model {
 public:
+    struct Face {
+        std::array<int, 3> vertex_ids{};
+        std::array<int, 3> normal_ids{};
+    };
+
     explicit Model(const std::string& path);
+    // Builds a model from in-memory data. With no normals, smooth vertex
+    // normals are generated the same way as for OBJ files without "vn".
+    // objects need only name, first_face and face_count, in face order;
+    // without any, the whole model is one object.
+    Model(std::vector<Vec3f> vertices,
+          std::vector<Vec3f> normals,
+          std::vector<Face> faces,
+          std::vector<ModelObject> objects = {});
 
     std::array<int, 3> face_vertex_indices(size_t face_id) const;
     std::array<int, 3> face_normal_indices(size_t face_id) const;
+    // Bit i is set when the edge from vertex i to vertex i + 1 borders no
+    // other face of the same object.
+    uint8_t face_open_edges(size_t face_id) const { return open_edges_.at(face_id); }
     Vec3f vertex(int index) const;
     Vec3f normal(int index) const;
     size_t face_count() const { return faces_.size(); }
+    size_t vertex_count() const { return vertices_.size(); }
+    size_t normal_count() const { return normals_.size(); }
+    // What the face vertex and normal indices index, for batch transforms.
+    const std::vector<Vec3f>& vertices() const { return vertices_; }
+    const std::vector<Vec3f>& normals() const { return normals_; }
+    // Bounds of every vertex.
+    const Aabb& bounds() const { return bounds_; }
+    const BoundingSphere& bounding_sphere() const { return sphere_; }
+    // Never empty for a model with faces; faces outside any "o"/"g" group
+    // form an unnamed object.
+    const std::vector<ModelObject>& objects() const { return objects_; }
+    // Grouped by object; ModelObject::first_meshlet indexes this.
+    const std::vector<Meshlet>& meshlets() const { return meshlets_; }
+    const std::vector<uint32_t>& meshlet_faces() const { return meshlet_faces_; }
 
 private:
-    struct Face {
-        std::array<int, 3> vertex_ids{};
-        std::array<int, 3> normal_ids{};
-    };
-
     std::vector<Vec3f> vertices_;
     std::vector<Vec3f> normals_;
     std::vector<Face> faces_;
+    std::vector<ModelObject> objects_;
+    Aabb bounds_;
+    BoundingSphere sphere_;
+    std::vector<uint8_t> open_edges_;
+    std::vector<Meshlet> meshlets_;
+    std::vector<uint32_t> meshlet_faces_;
+
+    void finalize_normals();
+    void finalize_objects();
+    void build_meshlets();
 };
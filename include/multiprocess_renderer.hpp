@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+struct MultiProcessConfig {
+    // 0 selects std::thread::hardware_concurrency() / threads_per_process.
+    int processes = 0;
+    int threads_per_process = 1;
+    // Restricts process i to CPUs [i * threads_per_process, ...). Linux only.
+    bool pin_processes = false;
+};
+
+struct MultiProcessStats {
+    double total_ms = 0.0;
+    std::vector<uint32_t> tiles_per_process;
+    // Tiles the coordinator re-rendered because their process died first.
+    uint32_t recovered_tiles = 0;
+    int failed_processes = 0;
+};
+
+// Renders one frame with forked worker processes sharing a POSIX shared
+// memory color and depth buffer. Tiles are handed out through an atomic
+// counter in the shared header; each process transforms and bins the whole
+// model and then rasterizes the tiles it claims. Output is identical to a
+// single-process render. fork() is called from render(), so other threads
+// of the caller must be idle at that point. POSIX only.
+class MultiProcessRenderer {
+public:
+    MultiProcessRenderer(int width, int height, MultiProcessConfig config = {});
+    ~MultiProcessRenderer();
+
+    MultiProcessRenderer(const MultiProcessRenderer&) = delete;
+    MultiProcessRenderer& operator=(const MultiProcessRenderer&) = delete;
+
+    MultiProcessStats render(const Model& model, IShader& shader);
+    // Views the shared color buffer; nothing is copied.
+    const Image& image() const { return image_; }
+    bool write_png(const std::string& path) const { return image_.write_png(path); }
+    const MultiProcessStats& stats() const { return stats_; }
+
+private:
+    struct SharedHeader;
+
+    int width_;
+    int height_;
+    MultiProcessConfig config_;
+    int tile_count_ = 0;
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    SharedHeader* header_ = nullptr;
+    std::atomic<uint8_t>* tile_states_ = nullptr;
+    std::atomic<uint32_t>* process_tiles_ = nullptr;
+    uint8_t* color_ = nullptr;
+    float* depth_ = nullptr;
+    Image image_;
+    MultiProcessStats stats_;
+
+    void render_worker(int process, const Model& model, IShader& shader);
+    void recover_tiles(const Model& model, IShader& shader);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bounds.hpp"
+#include "math.hpp"
+
+// Screen rectangle of a projected box in frame pixels, with its nearest depth
+// ordered like the standard (ndc.z + 1) / 2, smaller being nearer.
+struct ScreenBounds {
+    float x0 = 0.f;
+    float y0 = 0.f;
+    float x1 = 0.f;
+    float y1 = 0.f;
+    float nearest_depth = 0.f;
+};
+
+// Low-resolution masked depth buffer for occlusion culling, after Intel's
+// Masked Occlusion Culling. The frame is covered at 1/scale resolution in
+// tiles of 8x8 buffer pixels. Each tile keeps a reference depth z0 that
+// bounds every pixel of the tile, plus a partially covered working layer:
+// a coverage mask and the farthest depth z1 of the occluders merged into it.
+// When the working layer covers the tile it becomes the new reference.
+// Along an occluder's open edges only buffer pixels covered completely are
+// marked; edges shared with another face of the occluder sample the pixel
+// center with a tie rule, as MOC does everywhere, so a tessellated surface
+// covers the buffer without cracks. Depths are far bounds of the plane over
+// each tile.
+class OcclusionBuffer {
+public:
+    OcclusionBuffer() = default;
+    OcclusionBuffer(int width, int height, int scale);
+
+    // Covers a width x height frame; also clears.
+    void resize(int width, int height, int scale);
+    void clear();
+    // Clip transforms have a reversed-Z projection. Depths are still kept in
+    // the standard order, as 1 - z / w.
+    void set_reversed_z(bool reversed) { reversed_z_ = reversed; }
+
+    // Rasterizes a clip-space triangle as an occluder; open_edges is
+    // Model::face_open_edges. Triangles reaching behind the eye are skipped.
+    void render_occluder(const Vec4f& a, const Vec4f& b, const Vec4f& c, uint8_t open_edges = 0b111);
+
+    // False when the box crosses the near plane.
+    bool project(const Mat4f& clip_transform, const Aabb& box, ScreenBounds& bounds) const;
+    // True unless every buffer pixel the box could touch is covered by
+    // occluders nearer than the box.
+    bool visible(const ScreenBounds& bounds) const;
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    static constexpr int kTileSize = 8;
+
+    struct Tile {
+        // Pixels outside the buffer are permanently set.
+        uint64_t mask = 0;
+        float z0 = 0.f;
+        float z1 = 0.f;
+    };
+
+    int width_ = 0;
+    int height_ = 0;
+    int scale_ = 1;
+    int buffer_width_ = 0;
+    int buffer_height_ = 0;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+    std::vector<Tile> tiles_;
+    std::vector<uint64_t> outside_;
+    bool reversed_z_ = false;
+
+    void merge(Tile& tile, size_t index, uint64_t mask, float depth);
+    Vec3f to_screen(const Vec4f& clip) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+
+// Incremental RGB8 PNG encoder. Rows are filtered and deflated as they
+// arrive and each batch is flushed as its own IDAT chunk, so memory depends
+// on the row width and batch size but not on the image height.
+class PngStreamWriter : public IRowSink {
+public:
+    PngStreamWriter() = default;
+    ~PngStreamWriter() override;
+
+    PngStreamWriter(const PngStreamWriter&) = delete;
+    PngStreamWriter& operator=(const PngStreamWriter&) = delete;
+
+    bool open(const std::string& path, int width, int height);
+    bool write_rows(const uint8_t* rows, int count) override;
+    // Writes the final deflate block and IEND; fails if rows are missing.
+    bool finish();
+
+    int rows_written() const { return rows_written_; }
+
+private:
+    static constexpr size_t kWindowSize = 32768;
+    static constexpr size_t kHashSize = size_t{1} << 15;
+
+    std::ofstream out_;
+    int width_ = 0;
+    int height_ = 0;
+    int rows_written_ = 0;
+    bool failed_ = false;
+    std::vector<uint8_t> previous_row_;
+    std::vector<uint8_t> filtered_;
+    std::array<std::vector<uint8_t>, 5> candidates_;
+    std::vector<uint8_t> compressed_;
+    std::vector<int32_t> head_;
+    std::vector<int32_t> chain_;
+    uint64_t bit_buffer_ = 0;
+    int bit_count_ = 0;
+    uint32_t adler_a_ = 1;
+    uint32_t adler_b_ = 0;
+
+    void filter_row(const uint8_t* row);
+    void deflate_block(const uint8_t* data, size_t size, bool final_block);
+    void put_bits(uint32_t bits, int count);
+    void put_literal(int symbol);
+    void put_match(int length, int distance);
+    void flush_bits();
+    bool write_chunk(const char* type, const uint8_t* data, size_t size);
+};
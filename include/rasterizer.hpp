@@ -1,29 +1,509 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
 #include <vector>
 
+#include "depth_complexity.hpp"
+#include "frame_arena.hpp"
+#include "frustum.hpp"
 #include "image.hpp"
+#include "job_system.hpp"
 #include "model.hpp"
+#include "occlusion_buffer.hpp"
+#include "render_region.hpp"
+#include "render_stats.hpp"
+#include "scene.hpp"
 #include "shader.hpp"
 
+// Pixel order of the rasterizer's working color and depth buffers. Tiled
+// stores 8x8 pixel blocks contiguously and Morton also orders the pixels of
+// each block along a Z curve, so a triangle spanning a few rows touches far
+// fewer cache lines. Non-linear layouts are detiled into image() on output.
+enum class FramebufferLayout { Linear, Tiled, Morton };
+
+const char* framebuffer_layout_name(FramebufferLayout layout);
+bool parse_framebuffer_layout(const std::string& name, FramebufferLayout& layout);
+
+// Storage of the depth buffer. Float32 keeps (ndc.z + 1) / 2. ReversedFloat32
+// keeps ndc.z of a reversed-Z projection (Mat4f::perspective_reversed,
+// Camera::set_reversed_z), 1 at the near plane and 0 at the far plane, and
+// passes on greater; the shader must use such a projection. Unorm24 (3
+// packed bytes) and Unorm16 quantize the standard depth to cut depth
+// bandwidth.
+enum class DepthFormat { Float32, ReversedFloat32, Unorm24, Unorm16 };
+
+const char* depth_format_name(DepthFormat format);
+bool parse_depth_format(const std::string& name, DepthFormat& format);
+
+// Fragment shader invocations per pixel block within a tile. Coverage and
+// depth are always per pixel, so only the shading is coarsened.
+enum class ShadingRate : uint8_t { Full, Coarse2x2, Coarse4x4 };
+
+// Full, Coarse2x2 and Coarse4x4 use that rate for every tile; Adaptive picks
+// a rate per tile from the spread of the binned triangles' normals and view
+// depths; Image takes the rate of each tile from ShadingRateConfig::tile_rates.
+enum class ShadingRateMode { Full, Coarse2x2, Coarse4x4, Adaptive, Image };
+
+const char* shading_rate_mode_name(ShadingRateMode mode);
+// Accepts every mode except Image, which needs tile rates.
+bool parse_shading_rate_mode(const std::string& name, ShadingRateMode& mode);
+
+struct ShadingRateConfig {
+    ShadingRateMode mode = ShadingRateMode::Full;
+    // Adaptive: normal spread is the mean over the tile's triangles of
+    // 1 - |mean unit vertex normal|^2, depth spread the standard deviation
+    // of their vertex w over its mean. Tiles above max_depth_spread stay at full rate.
+    float normal_spread_4x4 = 0.01f;
+    float normal_spread_2x2 = 0.05f;
+    float max_depth_spread = 0.1f;
+    // Image: one rate per tile of region(), row-major, tile_count() entries.
+    std::vector<ShadingRate> tile_rates;
+};
+
+// Object-level occlusion culling. The objects with the largest projected
+// bounds are rasterized into a low-resolution OcclusionBuffer, and every
+// other object whose bounds are hidden behind them is dropped before the
+// vertex stage. Needs a shader with a clip_transform() and a model with more
+// than one object.
+struct OcclusionCullingConfig {
+    bool enabled = false;
+    int max_occluders = 16;
+    // Fraction of the frame an occluder's projected bounds must cover.
+    float min_occluder_area = 0.02f;
+    // Frame pixels per occlusion buffer pixel along each axis.
+    int buffer_scale = 4;
+};
+
+// Culling before the vertex stage. Frustum drops objects whose bounding box
+// and meshlets whose bounding sphere lie outside the clip volume;
+// FrustumCone also drops meshlets whose normal cone faces away from the eye.
+// Triangles are drawn two-sided, so back-facing meshlets only vanish unseen
+// on closed meshes. Needs a shader with a clip_transform().
+enum class ClusterCulling { Off, Frustum, FrustumCone };
+
+const char* cluster_culling_name(ClusterCulling mode);
+bool parse_cluster_culling(const std::string& name, ClusterCulling& mode);
+
+// Order in which triangles reach each tile. FrontToBack radix-sorts them by
+// their nearest vertex depth before binning, so the depth test rejects most
+// hidden fragments before they are shaded. Triangles at equal depth may then
+// resolve differently than in Submission (model face) order.
+enum class DrawOrder { Submission, FrontToBack };
+
+const char* draw_order_name(DrawOrder order);
+bool parse_draw_order(const std::string& name, DrawOrder& order);
+
+// Hands out tiles to render. claim() is called concurrently by every worker;
+// each claimed tile is cleared, rendered and then passed to complete().
+class ITileSource {
+public:
+    virtual ~ITileSource() = default;
+    virtual bool claim(int& tile) = 0;
+    virtual void complete(int tile) = 0;
+};
+
 class Rasterizer {
 public:
     Rasterizer(int width, int height);
+    // Renders only the region's pixels of the virtual frame; image() is
+    // region-sized and bit-identical to the same pixels of a full render.
+    explicit Rasterizer(const RenderRegion& region);
+    // Renders into caller-owned region-sized RGB8 color and float depth
+    // buffers (e.g. shared memory). They must outlive the rasterizer.
+    Rasterizer(const RenderRegion& region, uint8_t* color, float* depth);
 
-    void render(const Model& model, IShader& shader);
+    // Optional scheduler; without one every stage runs on the calling thread.
+    void set_job_system(JobSystem* jobs) { jobs_ = jobs; }
+    // DepthComplexity skips fragment shading and records per-pixel counts instead.
+    void set_debug_mode(DebugMode mode) { debug_mode_ = mode; }
+    void set_stage_observer(IStageObserver* observer) { observer_ = observer; }
+    void set_clear_color(const Vec3f& color) { clear_color_ = color; }
+    // Only Linear and Float32 are supported with caller-owned buffers.
+    void set_framebuffer_layout(FramebufferLayout layout);
+    FramebufferLayout framebuffer_layout() const { return layout_; }
+    void set_depth_format(DepthFormat format);
+    DepthFormat depth_format() const { return depth_format_; }
+    // 1 or 4. With 4 samples coverage and depth are evaluated per sample but
+    // the fragment shader runs once per pixel and triangle; its color is
+    // stored to the covered samples and averaged into image() on resolve.
+    // Only 1 is supported with caller-owned buffers.
+    void set_sample_count(int samples);
+    int sample_count() const { return samples_; }
+    // Coarse rates apply to single-sampled rendering outside DepthComplexity
+    // mode; otherwise every tile is shaded at full rate.
+    void set_shading_rate(ShadingRateConfig config);
+    const ShadingRateConfig& shading_rate() const { return shading_rate_; }
+    void set_draw_order(DrawOrder order) { draw_order_ = order; }
+    DrawOrder draw_order() const { return draw_order_; }
+    // Each tile first rasterizes all of its triangles depth-only, then shades
+    // only the first fragment per pixel whose depth equals the stored one, so
+    // every pixel is shaded once. The image matches a single-pass render.
+    // Applies to single-sampled rendering outside DepthComplexity mode.
+    void set_depth_prepass(bool enabled) { depth_prepass_ = enabled; }
+    bool depth_prepass() const { return depth_prepass_; }
+    void set_occlusion_culling(const OcclusionCullingConfig& config);
+    const OcclusionCullingConfig& occlusion_culling() const { return occlusion_; }
+    void set_cluster_culling(ClusterCulling mode) { cluster_culling_ = mode; }
+    ClusterCulling cluster_culling() const { return cluster_culling_; }
+    // With a tile source render() skips the frame clear and only renders the
+    // tiles it hands out, so several renderers can share one target.
+    void set_tile_source(ITileSource* source) { tile_source_ = source; }
+
+    static int tile_count(const RenderRegion& region);
+
+    RenderStats render(const Model& model, IShader& shader);
+    // Renders every instance of every draw into one frame with a single
+    // clear. Instances are transformed by batch kernels straight from the
+    // shared model data instead of through IShader::vertex, and each
+    // triangle is shaded with its draw's material. Triangles go through the
+    // tiles in passes of at most kScenePassTriangles, so memory is bounded
+    // however many instances there are; draw order and the depth prepass
+    // apply within a pass. With cluster culling on, instances whose world
+    // bounds lie outside the frustum are skipped. Not supported with a tile
+    // source.
+    RenderStats render(const Scene& scene);
+    // Out-of-core mode: renders the whole virtual frame in bands of
+    // region().height() rows, reusing this rasterizer's band-sized buffers,
+    // and passes each finished band to sink. The region must be full width
+    // and start at row 0. Memory is bounded by the band, not the frame.
+    RenderStats render_bands(const Model& model, IShader& shader, IRowSink& sink);
     bool write_png(const std::string& path) const;
-    const Image& image() const { return color_buffer_; }
+    // Fills tiles nothing was drawn into with the clear color on first access.
+    const Image& image() const {
+        resolve_clears();
+        return color_buffer_;
+    }
+    const RenderStats& stats() const { return stats_; }
+    const RenderRegion& region() const { return region_; }
+    FrameArenaStats memory_stats() const { return arena_.stats(); }
+    const DepthComplexity& depth_complexity() const { return complexity_; }
 
 private:
+    static constexpr int kTileSize = 64;
+    static constexpr size_t kBinBatch = 4096;
+    static constexpr uint32_t kBinChunkCapacity = 60;
+    static constexpr int kBlockSize = 8;
+    static constexpr int kMsaaSamples = 4;
+    static constexpr int kDepthKeyBits = 16;
+    static constexpr size_t kSortPrefetch = 8;
+    static constexpr size_t kSortChunk = 16384;
+    static constexpr size_t kScenePassTriangles = size_t{1} << 18;
+    static constexpr size_t kSceneVertexGrain = 4096;
+    static constexpr size_t kShadeBatchQuads = 1024;
+
+    enum TileState : uint8_t {
+        kTileResolved,
+        // Logically holds only the clear value; memory is stale.
+        kTileCleared,
+        // Drawn in a non-linear layout or multisampled and not yet resolved
+        // into color_buffer_.
+        kTileDirty,
+    };
+
     struct RasterVertex {
         std::array<float, 2> screen_pos{};
         float depth = 0.f;
         VertexOutput payload;
     };
 
-    Image color_buffer_;
-    std::vector<float> depth_buffer_;
+    // f(x, y) = value + (x - origin.x) * ddx + (y - origin.y) * ddy.
+    struct Plane {
+        float value = 0.f;
+        float ddx = 0.f;
+        float ddy = 0.f;
+
+        template <typename T>
+        T at(T dx, T dy) const {
+            return value + dx * ddx + dy * ddy;
+        }
+    };
+
+    // Screen-space plane equations built in triangle setup for 1/w and for
+    // each vertex output divided by w. The perspective-correct attribute at
+    // a pixel is then plane.at(dx, dy) / inv_w.at(dx, dy).
+    struct AttributePlanes {
+        std::array<float, 2> origin{};
+        Plane inv_w;
+        std::array<Plane, 3> world_position;
+        std::array<Plane, 3> normal;
+    };
+
+    struct Triangle {
+        std::array<RasterVertex, 3> verts;
+        AttributePlanes planes;
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = -1;
+        int y1 = -1;
+        // Scene rendering: index of the draw whose shader shades it.
+        uint32_t draw = 0;
+    };
+
+    struct TileRect {
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = -1;
+        int y1 = -1;
+    };
+
+    struct BinChunk {
+        BinChunk* next;
+        uint32_t count;
+        uint32_t ids[kBinChunkCapacity];
+    };
+
+    struct BinList {
+        BinChunk* head;
+        BinChunk* tail;
+    };
+
+    // Clamped: the bounding box was cut to the region; no geometry is clipped.
+    enum class BinResult { Binned, Clamped, Culled };
+
+    // Scene rendering: an instance that survived culling, in draw order.
+    struct SceneInstance {
+        uint32_t draw;
+        uint32_t instance;
+    };
+
+    // An instance of the current pass. Its triangles, transformed vertices
+    // and normals start at the first_* offsets of the pass's arrays.
+    struct PassInstance {
+        const Model* model;
+        uint32_t draw;
+        Mat4f clip;
+        Mat4f world;
+        size_t first_triangle;
+        size_t first_vertex;
+        size_t first_normal;
+    };
+
+    // The position part of a VertexOutput.
+    struct TransformedVertex {
+        Vec4f clip_position;
+        Vec3f world_position;
+        float reciprocal_w;
+    };
+
+    // A 2x2 quad with at least one lane that passed the depth test; x and y
+    // are the top-left pixel. Lane i is the block (i & 1, i >> 1) of
+    // 2^rate_shift pixels square, so at full rate lanes are pixels.
+    struct PendingQuad {
+        int x;
+        int y;
+        uint32_t mask = 0;
+        // Covered pixels of the quad's footprint, bit py * footprint + px.
+        uint64_t coverage = 0;
+        // Multisampled rendering only: bit 4 * lane + sample is set for
+        // samples that passed the depth test, and each lane is shaded at its
+        // pixel center plus offset.
+        uint32_t sample_mask = 0;
+        std::array<float, FragmentQuad::kLanes> offset_x{};
+        std::array<float, FragmentQuad::kLanes> offset_y{};
+    };
+
+    // Quads that passed the depth test in a tile, shaded in submission order
+    // when the batch fills up and when the tile is done. Run i covers quads
+    // [runs[i - 1].end, runs[i].end) of one triangle.
+    struct ShadeQueue {
+        struct Run {
+            const Triangle* tri;
+            const IShader* shader;
+            int rate_shift;
+            size_t end;
+        };
+        std::vector<PendingQuad> quads;
+        std::vector<Run> runs;
+    };
+
+    struct TileCounters {
+        uint64_t pixels_tested = 0;
+        uint64_t depth_tests = 0;
+        uint64_t depth_passed = 0;
+        uint64_t fragments_shaded = 0;
+        uint64_t pixels_covered = 0;
+        uint64_t shade_ns = 0;
+    };
+
+    struct FrameCounters {
+        std::atomic<uint64_t> triangles_culled{0};
+        std::atomic<uint64_t> triangles_bbox_clamped{0};
+        std::atomic<uint64_t> pixels_tested{0};
+        std::atomic<uint64_t> depth_tests{0};
+        std::atomic<uint64_t> depth_passed{0};
+        std::atomic<uint64_t> fragments_shaded{0};
+        std::atomic<uint64_t> pixels_covered{0};
+        std::atomic<uint64_t> shade_ns{0};
+        std::atomic<uint64_t> tile_ns{0};
+
+        void reset();
+    };
+
+    RenderRegion region_;
+    mutable Image color_buffer_;
+    Vec3f clear_color_{0.f, 0.f, 0.f};
+    mutable std::vector<uint8_t> tile_state_;
+    FramebufferLayout layout_ = FramebufferLayout::Linear;
+    bool external_target_ = false;
+    int blocks_x_ = 0;
+    std::vector<uint8_t> tiled_color_;
+    int samples_ = 1;
+    // Sample s of working pixel p lives at s * sample_plane_ + p in the
+    // depth buffer and in sample_color_.
+    size_t sample_plane_ = 0;
+    std::vector<uint8_t> sample_color_;
+    ShadingRateConfig shading_rate_;
+    DrawOrder draw_order_ = DrawOrder::Submission;
+    bool depth_prepass_ = false;
+    OcclusionCullingConfig occlusion_;
+    OcclusionBuffer occlusion_buffer_;
+    ClusterCulling cluster_culling_ = ClusterCulling::Off;
+    std::vector<uint8_t> depth_storage_;
+    void* depth_ = nullptr;
+    DepthFormat depth_format_ = DepthFormat::Float32;
+    JobSystem* jobs_ = nullptr;
+    ITileSource* tile_source_ = nullptr;
+    DebugMode debug_mode_ = DebugMode::None;
+    IStageObserver* observer_ = nullptr;
+    DepthComplexity complexity_;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+    FrameArena arena_;
+    Triangle* triangles_ = nullptr;
+    size_t triangle_count_ = 0;
+    // Model faces that survived occlusion and cluster culling, one per
+    // triangle; null when every face is drawn.
+    const uint32_t* visible_faces_ = nullptr;
+    // FrontToBack only: quantized nearest depth of each triangle, written
+    // by the vertex stage.
+    uint16_t* depth_keys_ = nullptr;
+    // Binning order of triangles_ ids; null bins them in submission order.
+    const uint32_t* draw_order_ids_ = nullptr;
+    BinList* bins_ = nullptr;
+    BinList* band_bins_ = nullptr;
+    size_t batch_count_ = 0;
+    std::vector<ShadeQueue> shade_queues_;
+    std::vector<SceneInstance> scene_instances_;
+    std::vector<uint8_t> instance_visible_;
+    // One shader per draw of the scene being rendered, indexed by
+    // Triangle::draw; null outside render(const Scene&).
+    std::vector<PhongShader> scene_shaders_;
+    const PhongShader* draw_shaders_ = nullptr;
+    PassInstance* pass_instances_ = nullptr;
+    size_t pass_instance_count_ = 0;
+    TransformedVertex* pass_vertices_ = nullptr;
+    Vec3f* pass_normals_ = nullptr;
+    FrameCounters counters_;
+    mutable RenderStats stats_;
+
+    void begin_stage(RenderStage stage) {
+        if (observer_) {
+            observer_->stage_begin(stage);
+        }
+    }
+    void end_stage(RenderStage stage) {
+        if (observer_) {
+            observer_->stage_end(stage);
+        }
+    }
+    int worker_index() const { return jobs_ ? jobs_->current_worker() : 0; }
+    void parallel_for(size_t count, size_t grain, const JobSystem::RangeFn& fn);
+    int begin_frame();
+    void clear_buffers();
+    void vertex_stage(const Model& model, IShader& shader);
+    void setup_stage();
+    void cull_instances(const Scene& scene);
+    size_t begin_scene_pass(const Scene& scene, size_t first_instance);
+    void transform_pass_vertices(size_t begin, size_t end);
+    void transform_pass_normals(size_t begin, size_t end);
+    void assemble_pass_triangles(size_t begin, size_t end);
+    void cull_geometry(const Model& model, const IShader& shader);
+    void cull_occluded_objects(const Model& model, const Mat4f& clip, uint8_t* object_visible);
+    void cull_clusters(const Model& model,
+                       const Frustum& frustum,
+                       const Mat4f& clip,
+                       const uint8_t* object_visible,
+                       uint8_t* meshlet_visible);
+    void tile_stage(const IShader& shader, int workers);
+    void split_tile_time(double tile_phase_ms);
+    void publish_counters();
+    void transform_vertices(const Model& model, IShader& shader, size_t begin, size_t end);
+    void project_vertices(size_t id);
+    void sort_draw_order();
+    void bin_triangles(size_t batch);
+    void bin_bands(size_t batch, int band_rows, size_t band_count);
+    void bin_band_triangles(size_t batch, size_t band, size_t band_count);
+    // Bins by bounding box only; callers set up the planes of binned triangles.
+    BinResult bin_triangle(uint32_t id, BinList* bins, PoolAllocator& pool);
+    static void setup_planes(Triangle& tri);
+    TileRect tile_rect(int tile) const;
+    int tile_rate_shift(int tile) const;
+    void clear_tile(int tile);
+    void resolve_clears() const;
+    void detile(const TileRect& rect) const;
+    size_t working_offset(int x, int y) const;
+    void allocate_working_buffers();
+    void fill_depth(size_t offset, size_t count);
+    uint8_t* color_data() { return layout_ == FramebufferLayout::Linear ? color_buffer_.data() : tiled_color_.data(); }
+
+    template <FramebufferLayout kLayout>
+    size_t pixel_offset(int x, int y) const {
+        if constexpr (kLayout == FramebufferLayout::Linear) {
+            return static_cast<size_t>(y) * color_buffer_.width() + x;
+        } else {
+            size_t block = static_cast<size_t>(y / kBlockSize) * blocks_x_ + x / kBlockSize;
+            unsigned bx = static_cast<unsigned>(x % kBlockSize);
+            unsigned by = static_cast<unsigned>(y % kBlockSize);
+            if constexpr (kLayout == FramebufferLayout::Tiled) {
+                return block * kBlockSize * kBlockSize + by * kBlockSize + bx;
+            } else {
+                unsigned morton = (bx & 1) | (by & 1) << 1 | (bx & 2) << 1 | (by & 2) << 2 | (bx & 4) << 2 |
+                                  (by & 4) << 3;
+                return block * kBlockSize * kBlockSize + morton;
+            }
+        }
+    }
+    void raster_tile(int tile, const IShader& shader);
+    template <DepthFormat kFormat>
+    void raster_tile_as(int tile, const IShader& shader);
+    template <FramebufferLayout kLayout, DepthFormat kFormat>
+    void raster_tile_in(int tile, const IShader& shader);
+    bool pixel_depth(const Triangle& tri, int x, int y, float& depth) const;
+    template <bool kFreshTile, FramebufferLayout kLayout, DepthFormat kFormat>
+    void raster_depth(const Triangle& tri, const TileRect& rect, TileCounters& counters);
+    // kDepthEqual is the shading pass after a depth prepass: a pixel passes
+    // when its depth equals the stored depth and its bit in shaded_rows (one
+    // row of tile pixels per entry) is still clear.
+    template <bool kCountComplexity, bool kFreshTile, bool kDepthEqual, FramebufferLayout kLayout, DepthFormat kFormat>
+    void raster_triangle(const Triangle& tri,
+                         const TileRect& rect,
+                         const IShader& shader,
+                         int rate_shift,
+                         TileCounters& counters,
+                         ShadeQueue& queue,
+                         uint64_t* shaded_rows = nullptr);
+    // Closes the run of quads tri just queued and shades the queue once it
+    // holds a full batch.
+    template <FramebufferLayout kLayout>
+    void queue_run(const Triangle& tri, const IShader& shader, int rate_shift, ShadeQueue& queue,
+                   TileCounters& counters);
+    template <FramebufferLayout kLayout>
+    void flush_shading(ShadeQueue& queue, TileCounters& counters);
+    template <FramebufferLayout kLayout>
+    void shade_quads(const Triangle& tri,
+                     const PendingQuad* quads,
+                     size_t count,
+                     const IShader& shader,
+                     int rate_shift);
+    template <bool kCountComplexity, bool kFreshTile, FramebufferLayout kLayout, DepthFormat kFormat>
+    void raster_triangle_msaa(const Triangle& tri,
+                              const TileRect& rect,
+                              const IShader& shader,
+                              TileCounters& counters,
+                              ShadeQueue& queue);
 
     static Vec3f barycentric(const std::array<float, 2>& a,
                              const std::array<float, 2>& b,
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "image.hpp"
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1) of a virtual frame of
+// frame_width x frame_height pixels.
+struct RenderRegion {
+    int frame_width = 0;
+    int frame_height = 0;
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+
+    static RenderRegion full_frame(int width, int height) {
+        return {width, height, 0, 0, width, height};
+    }
+};
+
+struct RegionImage {
+    RenderRegion region;
+    Image image;
+};
+
+// Splits a frame into columns x rows regions in row-major order.
+std::vector<RenderRegion> split_frame(int frame_width, int frame_height, int columns, int rows);
+
+// Stitches rendered regions back into one frame-sized image.
+Image assemble_regions(int frame_width, int frame_height, const std::vector<RegionImage>& parts);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+struct RenderStats {
+    double clear_ms = 0.0;
+    double vertex_ms = 0.0;
+    double setup_ms = 0.0;
+    double raster_ms = 0.0;
+    double shade_ms = 0.0;
+    double encode_ms = 0.0;
+    double total_ms = 0.0;
+
+    uint64_t triangles_submitted = 0;
+    uint64_t triangles_culled = 0;
+    // Triangles whose screen bounds were clamped to the region; not geometric clipping.
+    uint64_t triangles_bbox_clamped = 0;
+    uint64_t pixels_tested = 0;
+    uint64_t depth_tests = 0;
+    uint64_t depth_passed = 0;
+    uint64_t fragments_shaded = 0;
+    uint64_t pixels_covered = 0;
+    // Occlusion culling: objects tested against the occluders, those found
+    // hidden, and their faces, which are not part of triangles_submitted.
+    uint64_t objects_tested = 0;
+    uint64_t objects_occluded = 0;
+    uint64_t triangles_occluded = 0;
+    // Cluster culling: objects outside the frustum, meshlets of the others
+    // tested, those outside the frustum or facing away, and their faces
+    // (including those of the objects outside).
+    uint64_t objects_outside = 0;
+    uint64_t clusters_tested = 0;
+    uint64_t clusters_outside = 0;
+    uint64_t clusters_back_facing = 0;
+    uint64_t triangles_cluster_culled = 0;
+    // Scene rendering: instances drawn, those skipped because their world
+    // bounds lie outside the frustum (their faces count as cluster culled),
+    // and the tile passes the frame was split into.
+    uint64_t instances_drawn = 0;
+    uint64_t instances_outside = 0;
+    uint64_t scene_passes = 0;
+
+    double overdraw() const {
+        return pixels_covered > 0 ? static_cast<double>(fragments_shaded) / pixels_covered : 0.0;
+    }
+
+    void print(std::ostream& out) const;
+    std::string to_json() const;
+};
+
+enum class RenderStage {
+    Clear,
+    Vertex,
+    Setup,
+    Raster,
+};
+
+constexpr int kRenderStageCount = 4;
+
+// Notified on the thread that called Rasterizer::render around each pipeline
+// stage. Raster covers the whole tile phase, shading included.
+class IStageObserver {
+public:
+    virtual ~IStageObserver() = default;
+    virtual void stage_begin(RenderStage stage) = 0;
+    virtual void stage_end(RenderStage stage) = 0;
+};
+
+using StatsClock = std::chrono::steady_clock;
+
+inline double elapsed_ms(StatsClock::time_point start, StatsClock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "math.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+// One model drawn with one material at each of its instance transforms
+// (object to world, affine). The model is referenced, not copied.
+struct DrawItem {
+    const Model* model = nullptr;
+    std::vector<Mat4f> instances;
+    Material material;
+};
+
+// Draws sharing one camera and light setup, rendered in a single frame by
+// Rasterizer::render(const Scene&). Models must outlive the scene.
+class Scene {
+public:
+    // View, projection, lights and exposure of every draw. Its model matrix
+    // and material are replaced by each instance's and draw's.
+    PhongShader& shading() { return shading_; }
+    const PhongShader& shading() const { return shading_; }
+
+    DrawItem& add(const Model& model, std::vector<Mat4f> instances, const Material& material = {});
+    void clear() { draws_.clear(); }
+
+    const std::vector<DrawItem>& draws() const { return draws_; }
+    size_t instance_count() const;
+    // Faces over all instances.
+    size_t triangle_count() const;
+
+private:
+    PhongShader shading_;
+    std::vector<DrawItem> draws_;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "model.hpp"
+
+// Procedural meshes for scaling tests. All generators are deterministic for a
+// given seed and fit inside roughly [-1, 1]^3 unless noted otherwise.
+
+// Icosphere with 20 * 4^subdivisions triangles.
+Model make_sphere(int subdivisions);
+
+// Height-field terrain on a grid x grid quad lattice (2 * grid^2 triangles).
+Model make_terrain(int grid, float height_scale = 0.25f, uint32_t seed = 1);
+
+// count_x * count_z copies of base laid out on the XZ plane, spacing apart,
+// one object per copy.
+Model make_instanced_grid(const Model& base, int count_x, int count_z, float spacing);
+
+// Long, thin triangles fanned across the unit square; aspect is length / width.
+Model make_slivers(size_t count, float aspect, uint32_t seed = 1);
+
+// layers screen-facing planes of grid x grid quads, emitted back to front so
+// every layer passes the depth test. Each layer is an object.
+Model make_stacked_planes(int layers, int grid, float spacing = 0.05f);
+
+// count random equilateral triangles of edge length size scattered over the
+// unit square facing +Z. Triangle count and size can be swept independently.
+Model make_triangle_field(size_t count, float size, uint32_t seed = 1);
+
+// Parses "sphere:N", "terrain:N", "grid:X:Z[:LEVEL]" (a level-3 sphere by
+// default), "slivers:COUNT:ASPECT", "planes:LAYERS:GRID" or
+// "field:COUNT:SIZE".
+Model make_synthetic(const std::string& spec);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <optional>
 
 #include "math.hpp"
 
@@ -16,12 +18,63 @@ struct VertexOutput {
     float reciprocal_w = 1.f;
 };
 
+// Vertex outputs interpolated perspective-correctly at one pixel.
+struct Fragment {
+    Vec3f world_position;
+    Vec3f normal;
+};
+
+// Lane i of a 2x2 pixel quad is pixel (x + (i & 1), y + (i >> 1)).
+struct QuadVec3 {
+    std::array<float, 4> x{};
+    std::array<float, 4> y{};
+    std::array<float, 4> z{};
+};
+
+// Fragments of one triangle for a 2x2 quad in SoA form. Lanes outside mask
+// are helper lanes: they are not written, but their attributes are still
+// evaluated from the triangle's plane equations so differences across the
+// quad are screen-space derivatives.
+struct FragmentQuad {
+    static constexpr int kLanes = 4;
+
+    QuadVec3 world_position;
+    QuadVec3 normal;
+    uint32_t mask = 0;
+
+    static float ddx(const std::array<float, kLanes>& lanes) { return lanes[1] - lanes[0]; }
+    static float ddy(const std::array<float, kLanes>& lanes) { return lanes[2] - lanes[0]; }
+};
+
+struct ColorQuad {
+    std::array<float, FragmentQuad::kLanes> r{};
+    std::array<float, FragmentQuad::kLanes> g{};
+    std::array<float, FragmentQuad::kLanes> b{};
+};
+
+// vertex() and fragment() are invoked concurrently from the rasterizer's
+// worker threads and must not mutate shared state. Attribute interpolation
+// is done by the rasterizer from per-triangle plane equations.
 class IShader {
 public:
     virtual ~IShader() = default;
     virtual VertexOutput vertex(const VertexInput& in) = 0;
-    virtual Vec3f fragment(const Vec3f& barycentric,
-                           const std::array<VertexOutput, 3>& data) const = 0;
+    virtual Vec3f fragment(const Fragment& in) const = 0;
+    // Shades the masked lanes of a quad. The rasterizer only calls this one;
+    // the default runs fragment() per lane.
+    virtual void fragment_quad(const FragmentQuad& quad, ColorQuad& out) const;
+    // Object space to clip space, when vertex() computes clip_position as this
+    // matrix times the position. Geometry culling needs it and is skipped
+    // for shaders that return nothing.
+    virtual std::optional<Mat4f> clip_transform() const { return std::nullopt; }
+};
+
+// Surface parameters of PhongShader.
+struct Material {
+    Vec3f ambient{0.1f, 0.1f, 0.1f};
+    Vec3f diffuse{0.7f, 0.7f, 0.7f};
+    Vec3f specular{0.3f, 0.3f, 0.3f};
+    float shininess = 32.f;
 };
 
 class PhongShader : public IShader {
@@ -37,11 +90,18 @@ public:
                       const Vec3f& diffuse,
                       const Vec3f& specular,
                       float shininess);
+    void set_material(const Material& material);
     void set_exposure(float exposure);
 
+    const Mat4f& view_matrix() const { return view_; }
+    const Mat4f& projection_matrix() const { return projection_; }
+    Material material() const { return {ambient_, diffuse_, specular_, shininess_}; }
+
     VertexOutput vertex(const VertexInput& in) override;
-    Vec3f fragment(const Vec3f& barycentric,
-                   const std::array<VertexOutput, 3>& data) const override;
+    Vec3f fragment(const Fragment& in) const override;
+    // Evaluates all four lanes with Float4 math; lane results match fragment().
+    void fragment_quad(const FragmentQuad& quad, ColorQuad& out) const override;
+    std::optional<Mat4f> clip_transform() const override { return mvp_; }
 
 private:
     Mat4f model_ = Mat4f::identity();
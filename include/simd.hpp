@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "math.hpp"
+
+// Four float lanes. Uses SSE2 when the target has it and plain arrays
+// otherwise. Every operation rounds exactly like the scalar float operation
+// it replaces, so packet and scalar code paths produce identical results.
+struct Float4 {
+#if defined(__SSE2__)
+    __m128 v;
+
+    Float4() : v(_mm_setzero_ps()) {}
+    explicit Float4(__m128 value) : v(value) {}
+    Float4(float value) : v(_mm_set1_ps(value)) {}
+
+    static Float4 load(const float* values) { return Float4(_mm_loadu_ps(values)); }
+    void store(float* values) const { _mm_storeu_ps(values, v); }
+#else
+    std::array<float, 4> v{};
+
+    Float4() = default;
+    Float4(float value) : v{value, value, value, value} {}
+
+    static Float4 load(const float* values) {
+        Float4 result;
+        for (int i = 0; i < 4; ++i) {
+            result.v[i] = values[i];
+        }
+        return result;
+    }
+    void store(float* values) const {
+        for (int i = 0; i < 4; ++i) {
+            values[i] = v[i];
+        }
+    }
+#endif
+
+    static Float4 load(const std::array<float, 4>& values) { return load(values.data()); }
+    void store(std::array<float, 4>& values) const { store(values.data()); }
+};
+
+// Lane masks are all-ones / all-zeros per lane, as returned by comparisons.
+#if defined(__SSE2__)
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(_mm_add_ps(a.v, b.v)); }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4(_mm_sub_ps(a.v, b.v)); }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4(_mm_mul_ps(a.v, b.v)); }
+inline Float4 operator/(Float4 a, Float4 b) { return Float4(_mm_div_ps(a.v, b.v)); }
+inline Float4 sqrt(Float4 a) { return Float4(_mm_sqrt_ps(a.v)); }
+inline Float4 operator<(Float4 a, Float4 b) { return Float4(_mm_cmplt_ps(a.v, b.v)); }
+inline Float4 operator==(Float4 a, Float4 b) { return Float4(_mm_cmpeq_ps(a.v, b.v)); }
+inline Float4 operator&(Float4 a, Float4 b) { return Float4(_mm_and_ps(a.v, b.v)); }
+inline Float4 operator|(Float4 a, Float4 b) { return Float4(_mm_or_ps(a.v, b.v)); }
+// mask ? a : b per lane.
+inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+    return Float4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+}
+// Bit i is set when lane i of mask is set.
+inline uint32_t lane_bits(Float4 mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask.v)); }
+#else
+namespace simd_detail {
+template <typename Op>
+Float4 per_lane(Float4 a, Float4 b, Op op) {
+    Float4 result;
+    for (int i = 0; i < 4; ++i) {
+        result.v[i] = op(a.v[i], b.v[i]);
+    }
+    return result;
+}
+
+inline float mask(bool set) { return std::bit_cast<float>(set ? 0xffffffffu : 0u); }
+inline uint32_t bits(float value) { return std::bit_cast<uint32_t>(value); }
+}
+
+inline Float4 operator+(Float4 a, Float4 b) { return simd_detail::per_lane(a, b, [](float x, float y) { return x + y; }); }
+inline Float4 operator-(Float4 a, Float4 b) { return simd_detail::per_lane(a, b, [](float x, float y) { return x - y; }); }
+inline Float4 operator*(Float4 a, Float4 b) { return simd_detail::per_lane(a, b, [](float x, float y) { return x * y; }); }
+inline Float4 operator/(Float4 a, Float4 b) { return simd_detail::per_lane(a, b, [](float x, float y) { return x / y; }); }
+inline Float4 sqrt(Float4 a) { return simd_detail::per_lane(a, a, [](float x, float) { return std::sqrt(x); }); }
+inline Float4 operator<(Float4 a, Float4 b) {
+    return simd_detail::per_lane(a, b, [](float x, float y) { return simd_detail::mask(x < y); });
+}
+inline Float4 operator==(Float4 a, Float4 b) {
+    return simd_detail::per_lane(a, b, [](float x, float y) { return simd_detail::mask(x == y); });
+}
+inline Float4 operator&(Float4 a, Float4 b) {
+    return simd_detail::per_lane(a, b, [](float x, float y) {
+        return std::bit_cast<float>(simd_detail::bits(x) & simd_detail::bits(y));
+    });
+}
+inline Float4 operator|(Float4 a, Float4 b) {
+    return simd_detail::per_lane(a, b, [](float x, float y) {
+        return std::bit_cast<float>(simd_detail::bits(x) | simd_detail::bits(y));
+    });
+}
+inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+    return simd_detail::per_lane(a, b, [&, lane = 0](float x, float y) mutable {
+        return simd_detail::bits(mask.v[lane++]) ? x : y;
+    });
+}
+inline uint32_t lane_bits(Float4 mask) {
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+        result |= (simd_detail::bits(mask.v[i]) >> 31) << i;
+    }
+    return result;
+}
+#endif
+
+// std::max(a, b) semantics: b only where a < b.
+inline Float4 max(Float4 a, Float4 b) { return select(a < b, b, a); }
+
+// Per-lane std::pow; there is no SIMD pow, but callers stay in packet form.
+inline Float4 pow(Float4 base, float exponent) {
+    std::array<float, 4> lanes;
+    base.store(lanes);
+    for (float& lane : lanes) {
+        lane = std::pow(lane, exponent);
+    }
+    return Float4::load(lanes);
+}
+
+// Three Float4 components, i.e. four Vec3f in SoA form.
+struct Vec3f4 {
+    Float4 x;
+    Float4 y;
+    Float4 z;
+};
+
+inline Vec3f4 splat(const Vec3f& v) { return {v.x, v.y, v.z}; }
+
+inline Vec3f4 operator+(const Vec3f4& a, const Vec3f4& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Vec3f4 operator-(const Vec3f4& a, const Vec3f4& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Vec3f4 operator*(const Vec3f4& v, Float4 s) { return {v.x * s, v.y * s, v.z * s}; }
+inline Float4 dot(const Vec3f4& a, const Vec3f4& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+// Same as normalize(Vec3f) per lane, including the zero-length case.
+inline Vec3f4 normalize(const Vec3f4& v) {
+    Float4 len = sqrt(dot(v, v));
+    Float4 zero = len == Float4(0.f);
+    return {select(zero, 0.f, v.x / len), select(zero, 0.f, v.y / len), select(zero, 0.f, v.z / len)};
+}
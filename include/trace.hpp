@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline markers exported as Chrome trace-event JSON (chrome://tracing,
+// ui.perfetto.dev). Every thread records into its own lock-free ring buffer;
+// while tracing is disabled a marker costs one relaxed load. Configure with
+// -DSR_ENABLE_TRACE=OFF to compile the markers out entirely.
+class Trace {
+public:
+    static void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static uint64_t now_ns();
+    static void record(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t arg);
+    // Names the calling thread in the exported trace; unnamed threads are
+    // listed as "thread N" in the order they first record.
+    static void set_thread_name(const std::string& name);
+
+    // Call while no thread is recording, e.g. after a frame has finished.
+    static bool write_chrome_json(const std::string& path);
+    static void clear();
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, int64_t arg = -1)
+        : name_(Trace::enabled() ? name : nullptr), arg_(arg), start_ns_(name_ ? Trace::now_ns() : 0) {}
+
+    ~TraceScope() {
+        if (name_) {
+            Trace::record(name_, start_ns_, Trace::now_ns(), arg_);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    int64_t arg_;
+    uint64_t start_ns_;
+};
+
+#define SR_TRACE_CONCAT_INNER(a, b) a##b
+#define SR_TRACE_CONCAT(a, b) SR_TRACE_CONCAT_INNER(a, b)
+
+#ifdef SR_ENABLE_TRACE
+#define TRACE_SCOPE(name) TraceScope SR_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceScope SR_TRACE_CONCAT(trace_scope_, __LINE__)(name, arg)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, arg) ((void)(arg))
+#endif
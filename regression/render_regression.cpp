@@ -0,0 +1,1079 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "camera.hpp"
+#include "image.hpp"
+#include "job_system.hpp"
+#include "model.hpp"
+#include "multiprocess_renderer.hpp"
+#include "png_stream.hpp"
+#include "rasterizer.hpp"
+#include "render_region.hpp"
+#include "render_stats.hpp"
+#include "scene.hpp"
+#include "scene_generator.hpp"
+#include "scene_setup.hpp"
+#include "shader.hpp"
+
+namespace {
+constexpr int kWidth = 256;
+constexpr int kHeight = 192;
+
+struct SceneCase {
+    const char* name;
+    const char* source;
+    bool synthetic;
+    // Back-facing clusters can only be culled without a trace on closed
+    // meshes.
+    bool closed;
+};
+
+const SceneCase kScenes[] = {
+    {"head", "models/african_head.obj", false, false},
+    {"sphere", "sphere:4", true, true},
+    {"planes", "planes:6:4", true, false},
+    {"field", "field:3000:0.08", true, false},
+    {"terrain", "terrain:48", true, false},
+};
+
+const char* const kTimedStages[] = {"clear", "vertex", "setup", "raster", "shade", "total"};
+
+struct Options {
+    std::string golden_dir = "regression/golden";
+    std::string out_dir = "regression_out";
+    std::string baseline_path;
+    bool update_golden = false;
+    bool update_baseline = false;
+    bool require_baseline = false;
+    int tolerance = 2;
+    double max_bad_fraction = 0.0;
+    double threshold = 0.25;
+    double min_delta_ms = 0.5;
+    int threads = 4;
+    int runs = 5;
+};
+
+struct Comparison {
+    int max_diff = 0;
+    size_t bad_pixels = 0;
+    Image diff{1, 1};
+};
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--golden-dir") {
+            options.golden_dir = value();
+        } else if (arg == "--out-dir") {
+            options.out_dir = value();
+        } else if (arg == "--baseline") {
+            options.baseline_path = value();
+        } else if (arg == "--update-golden") {
+            options.update_golden = true;
+        } else if (arg == "--update-baseline") {
+            options.update_baseline = true;
+        } else if (arg == "--require-baseline") {
+            options.require_baseline = true;
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::stoi(value());
+        } else if (arg == "--max-bad-fraction") {
+            options.max_bad_fraction = std::stod(value());
+        } else if (arg == "--threshold") {
+            options.threshold = std::stod(value());
+        } else if (arg == "--min-delta-ms") {
+            options.min_delta_ms = std::stod(value());
+        } else if (arg == "--threads") {
+            options.threads = std::stoi(value());
+        } else if (arg == "--runs") {
+            options.runs = std::max(1, std::stoi(value()));
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+    return options;
+}
+
+// Collects a banded render back into one frame.
+class FrameRowSink : public IRowSink {
+public:
+    explicit FrameRowSink(Image& frame) : frame_(frame) {}
+
+    bool write_rows(const uint8_t* rows, int count) override {
+        if (next_row_ + count > frame_.height()) {
+            return false;
+        }
+        size_t stride = static_cast<size_t>(frame_.width()) * 3;
+        std::copy(rows, rows + stride * count, frame_.data() + stride * next_row_);
+        next_row_ += count;
+        return true;
+    }
+
+private:
+    Image& frame_;
+    int next_row_ = 0;
+};
+
+bool write_ppm(const std::string& path, const Image& image) {
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n" << image.width() << " " << image.height() << "\n255\n";
+    out.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.byte_size()));
+    return static_cast<bool>(out);
+}
+
+bool read_ppm(const std::string& path, Image& image) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    int width = 0;
+    int height = 0;
+    int max_value = 0;
+    if (!(in >> magic >> width >> height >> max_value) || magic != "P6" || max_value != 255) {
+        return false;
+    }
+    in.get();
+    std::vector<uint8_t> bytes(static_cast<size_t>(width) * height * 3);
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+        return false;
+    }
+    image = Image(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* p = bytes.data() + (static_cast<size_t>(y) * width + x) * 3;
+            image.set_pixel(x, y, Vec3f{p[0] / 255.f, p[1] / 255.f, p[2] / 255.f});
+        }
+    }
+    return true;
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; ++k) {
+            crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+uint32_t read_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+           static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+// Decoder for a whole zlib stream (RFC 1950 / 1951), written independently
+// of PngStreamWriter so the two cannot share a misreading of the format.
+// Throws on anything malformed, including a wrong Adler-32.
+class Inflater {
+public:
+    explicit Inflater(const std::vector<uint8_t>& in) : in_(in) {}
+
+    std::vector<uint8_t> run() {
+        if (in_.size() < 6 || (in_[0] & 0x0f) != 8 || (in_[0] << 8 | in_[1]) % 31 != 0 || (in_[1] & 0x20)) {
+            throw std::runtime_error("bad zlib header");
+        }
+        pos_ = 2;
+        bool last = false;
+        while (!last) {
+            last = bits(1) != 0;
+            switch (bits(2)) {
+                case 0: stored(); break;
+                case 1: fixed(); break;
+                case 2: dynamic(); break;
+                default: throw std::runtime_error("bad deflate block type");
+            }
+        }
+        if (pos_ + 4 > in_.size()) {
+            throw std::runtime_error("missing Adler-32");
+        }
+        uint32_t a = 1;
+        uint32_t b = 0;
+        for (uint8_t byte : out_) {
+            a = (a + byte) % 65521u;
+            b = (b + a) % 65521u;
+        }
+        if (read_u32(in_.data() + pos_) != (b << 16 | a)) {
+            throw std::runtime_error("Adler-32 mismatch");
+        }
+        return std::move(out_);
+    }
+
+private:
+    // Canonical Huffman code: codes of each length and symbols in code order.
+    struct Huffman {
+        std::array<int, 16> count{};
+        std::vector<int> symbol;
+    };
+
+    const std::vector<uint8_t>& in_;
+    size_t pos_ = 0;
+    uint32_t bit_buffer_ = 0;
+    int bit_count_ = 0;
+    std::vector<uint8_t> out_;
+
+    int bits(int count) {
+        while (bit_count_ < count) {
+            if (pos_ >= in_.size()) {
+                throw std::runtime_error("deflate stream truncated");
+            }
+            bit_buffer_ |= static_cast<uint32_t>(in_[pos_++]) << bit_count_;
+            bit_count_ += 8;
+        }
+        int value = static_cast<int>(bit_buffer_ & ((1u << count) - 1));
+        bit_buffer_ >>= count;
+        bit_count_ -= count;
+        return value;
+    }
+
+    static Huffman build(const int* lengths, int n) {
+        Huffman code;
+        for (int i = 0; i < n; ++i) {
+            ++code.count[static_cast<size_t>(lengths[i])];
+        }
+        std::array<int, 16> offset{};
+        for (size_t len = 1; len < 15; ++len) {
+            offset[len + 1] = offset[len] + code.count[len];
+        }
+        code.symbol.resize(static_cast<size_t>(n));
+        for (int i = 0; i < n; ++i) {
+            if (lengths[i]) {
+                code.symbol[static_cast<size_t>(offset[static_cast<size_t>(lengths[i])]++)] = i;
+            }
+        }
+        code.count[0] = 0;
+        return code;
+    }
+
+    int decode(const Huffman& code) {
+        int value = 0;
+        int first = 0;
+        int index = 0;
+        for (size_t len = 1; len < 16; ++len) {
+            value |= bits(1);
+            int count = code.count[len];
+            if (value - count < first) {
+                return code.symbol[static_cast<size_t>(index + value - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            value <<= 1;
+        }
+        throw std::runtime_error("bad Huffman code");
+    }
+
+    void stored() {
+        bit_buffer_ = 0;
+        bit_count_ = 0;
+        if (pos_ + 4 > in_.size()) {
+            throw std::runtime_error("stored block truncated");
+        }
+        size_t length = in_[pos_] | in_[pos_ + 1] << 8;
+        size_t inverse = in_[pos_ + 2] | in_[pos_ + 3] << 8;
+        pos_ += 4;
+        if ((length ^ 0xffff) != inverse || pos_ + length > in_.size()) {
+            throw std::runtime_error("bad stored block");
+        }
+        out_.insert(out_.end(), in_.begin() + static_cast<std::ptrdiff_t>(pos_),
+                    in_.begin() + static_cast<std::ptrdiff_t>(pos_ + length));
+        pos_ += length;
+    }
+
+    void fixed() {
+        int lengths[288 + 30];
+        std::fill(lengths, lengths + 144, 8);
+        std::fill(lengths + 144, lengths + 256, 9);
+        std::fill(lengths + 256, lengths + 280, 7);
+        std::fill(lengths + 280, lengths + 288, 8);
+        std::fill(lengths + 288, lengths + 318, 5);
+        codes(build(lengths, 288), build(lengths + 288, 30));
+    }
+
+    void dynamic() {
+        static constexpr int kOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        int literals = bits(5) + 257;
+        int distances = bits(5) + 1;
+        int code_lengths = bits(4) + 4;
+        int lengths[320] = {};
+        for (int i = 0; i < code_lengths; ++i) {
+            lengths[kOrder[i]] = bits(3);
+        }
+        Huffman length_code = build(lengths, 19);
+        int n = 0;
+        while (n < literals + distances) {
+            int symbol = decode(length_code);
+            if (symbol < 16) {
+                lengths[n++] = symbol;
+                continue;
+            }
+            int value = 0;
+            int repeat = 0;
+            if (symbol == 16) {
+                if (n == 0) {
+                    throw std::runtime_error("bad code length repeat");
+                }
+                value = lengths[n - 1];
+                repeat = 3 + bits(2);
+            } else {
+                repeat = symbol == 17 ? 3 + bits(3) : 11 + bits(7);
+            }
+            if (n + repeat > literals + distances) {
+                throw std::runtime_error("too many code lengths");
+            }
+            std::fill(lengths + n, lengths + n + repeat, value);
+            n += repeat;
+        }
+        codes(build(lengths, literals), build(lengths + literals, distances));
+    }
+
+    void codes(const Huffman& literal_code, const Huffman& distance_code) {
+        static constexpr int kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static constexpr int kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static constexpr int kDistanceBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                                  33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                                  1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static constexpr int kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                   6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        for (;;) {
+            int symbol = decode(literal_code);
+            if (symbol < 256) {
+                out_.push_back(static_cast<uint8_t>(symbol));
+                continue;
+            }
+            if (symbol == 256) {
+                return;
+            }
+            symbol -= 257;
+            if (symbol >= 29) {
+                throw std::runtime_error("bad length symbol");
+            }
+            int length = kLengthBase[symbol] + bits(kLengthExtra[symbol]);
+            int distance_symbol = decode(distance_code);
+            if (distance_symbol >= 30) {
+                throw std::runtime_error("bad distance symbol");
+            }
+            size_t distance = static_cast<size_t>(kDistanceBase[distance_symbol] + bits(kDistanceExtra[distance_symbol]));
+            if (distance > out_.size()) {
+                throw std::runtime_error("distance before start of stream");
+            }
+            for (int i = 0; i < length; ++i) {
+                out_.push_back(out_[out_.size() - distance]);
+            }
+        }
+    }
+};
+
+// Reads an 8-bit RGB, non-interlaced PNG, checking every chunk CRC. IDAT
+// payloads are joined before inflating, so a deflate stream split across
+// chunks at any bit is decoded as one.
+bool read_png(const std::string& path, Image& image) {
+    static constexpr uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (file.size() < sizeof(kSignature) || !std::equal(kSignature, kSignature + 8, file.begin())) {
+        return false;
+    }
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> zlib;
+    bool ended = false;
+    for (size_t pos = sizeof(kSignature); !ended;) {
+        if (pos + 12 > file.size()) {
+            return false;
+        }
+        size_t length = read_u32(file.data() + pos);
+        if (pos + 12 + length > file.size()) {
+            return false;
+        }
+        const uint8_t* type = file.data() + pos + 4;
+        const uint8_t* data = type + 4;
+        if (crc32(0, type, length + 4) != read_u32(data + length)) {
+            throw std::runtime_error("bad CRC in " + std::string(reinterpret_cast<const char*>(type), 4) + " chunk");
+        }
+        std::string name(reinterpret_cast<const char*>(type), 4);
+        if (name == "IHDR") {
+            if (length != 13 || data[8] != 8 || data[9] != 2 || data[12] != 0) {
+                return false;
+            }
+            width = static_cast<int>(read_u32(data));
+            height = static_cast<int>(read_u32(data + 4));
+        } else if (name == "IDAT") {
+            zlib.insert(zlib.end(), data, data + length);
+        } else if (name == "IEND") {
+            ended = true;
+        }
+        pos += 12 + length;
+    }
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    std::vector<uint8_t> filtered = Inflater(zlib).run();
+    size_t stride = static_cast<size_t>(width) * 3;
+    if (filtered.size() != (stride + 1) * height) {
+        throw std::runtime_error("PNG image data has the wrong size");
+    }
+    image = Image(width, height);
+    std::vector<uint8_t> previous(stride, 0);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* line = filtered.data() + (stride + 1) * y;
+        uint8_t* row = image.data() + stride * y;
+        for (size_t i = 0; i < stride; ++i) {
+            int a = i >= 3 ? row[i - 3] : 0;
+            int b = previous[i];
+            int c = i >= 3 ? previous[i - 3] : 0;
+            int predicted = 0;
+            switch (line[0]) {
+                case 0: break;
+                case 1: predicted = a; break;
+                case 2: predicted = b; break;
+                case 3: predicted = (a + b) >> 1; break;
+                case 4: {
+                    int p = a + b - c;
+                    int pa = std::abs(p - a);
+                    int pb = std::abs(p - b);
+                    int pc = std::abs(p - c);
+                    predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                    break;
+                }
+                default: throw std::runtime_error("bad PNG filter type");
+            }
+            row[i] = static_cast<uint8_t>(line[1 + i] + predicted);
+        }
+        std::copy(row, row + stride, previous.begin());
+    }
+    return true;
+}
+
+Comparison compare(const Image& actual, const Image& expected, int tolerance) {
+    Comparison result;
+    if (actual.width() != expected.width() || actual.height() != expected.height()) {
+        result.max_diff = 255;
+        result.bad_pixels = static_cast<size_t>(actual.width()) * actual.height();
+        return result;
+    }
+    result.diff = Image(actual.width(), actual.height());
+    const uint8_t* a = actual.data();
+    const uint8_t* b = expected.data();
+    for (int y = 0; y < actual.height(); ++y) {
+        for (int x = 0; x < actual.width(); ++x) {
+            size_t index = (static_cast<size_t>(y) * actual.width() + x) * 3;
+            int pixel_diff = 0;
+            for (int c = 0; c < 3; ++c) {
+                pixel_diff = std::max(pixel_diff, std::abs(static_cast<int>(a[index + c]) - b[index + c]));
+            }
+            result.max_diff = std::max(result.max_diff, pixel_diff);
+            if (pixel_diff > tolerance) {
+                ++result.bad_pixels;
+            }
+            float amplified = std::min(1.f, static_cast<float>(pixel_diff) * 16.f / 255.f);
+            result.diff.set_pixel(x, y, pixel_diff > tolerance ? Vec3f{1.f, amplified * 0.5f, 0.f}
+                                                               : Vec3f{amplified, amplified, amplified});
+        }
+    }
+    return result;
+}
+
+std::map<std::string, double> read_baseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string scene;
+    std::string stage;
+    double ms = 0.0;
+    while (in >> scene >> stage >> ms) {
+        baseline[scene + " " + stage] = ms;
+    }
+    return baseline;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : 0.5 * (values[mid - 1] + values[mid]);
+}
+
+std::vector<double> stage_values(const RenderStats& stats) {
+    return {stats.clear_ms, stats.vertex_ms, stats.setup_ms, stats.raster_ms, stats.shade_ms, stats.total_ms};
+}
+
+// Starts a result line: the label, padded to line up the longest scene
+// label, and the verdict. The caller appends the details and the newline.
+std::ostream& report(const std::string& label, bool ok) {
+    constexpr int kLabelWidth = 22;
+    return std::cout << "  " << std::left << std::setw(kLabelWidth) << label << std::right << " "
+                     << (ok ? "ok  " : "FAIL");
+}
+
+bool check_image(const Options& options,
+                 const std::string& label,
+                 const Image& actual,
+                 const Image& golden) {
+    Comparison result = compare(actual, golden, options.tolerance);
+    size_t pixels = static_cast<size_t>(golden.width()) * golden.height();
+    double bad_fraction = static_cast<double>(result.bad_pixels) / static_cast<double>(std::max<size_t>(1, pixels));
+    bool ok = bad_fraction <= options.max_bad_fraction;
+    report(label, ok) << "  max diff " << result.max_diff << ", " << result.bad_pixels << " pixels over tolerance"
+                      << std::endl;
+    if (!ok) {
+        std::string base = options.out_dir + "/" + label;
+        actual.write_png(base + "_actual.png");
+        golden.write_png(base + "_golden.png");
+        result.diff.write_png(base + "_diff.png");
+    }
+    return ok;
+}
+
+// Paints every covered pixel white, so a multisampled render over black
+// resolves to the fraction of each pixel's samples covered.
+class CoverageShader : public PhongShader {
+public:
+    explicit CoverageShader(const PhongShader& base) : PhongShader(base) {}
+
+    Vec3f fragment(const Fragment&) const override { return {1.f, 1.f, 1.f}; }
+    void fragment_quad(const FragmentQuad&, ColorQuad& out) const override {
+        out.r.fill(1.f);
+        out.g.fill(1.f);
+        out.b.fill(1.f);
+    }
+};
+
+// Colors each pixel by the normal of the triangle plane it sees, taken from
+// the quad's position derivatives. A multisampled pixel whose samples see
+// more than one plane resolves to a blend, unlike in a single-sampled render.
+class FacetShader : public PhongShader {
+public:
+    explicit FacetShader(const PhongShader& base) : PhongShader(base) {}
+
+    Vec3f fragment(const Fragment&) const override { return {1.f, 1.f, 1.f}; }
+    void fragment_quad(const FragmentQuad& quad, ColorQuad& out) const override {
+        const QuadVec3& p = quad.world_position;
+        Vec3f dx{p.x[1] - p.x[0], p.y[1] - p.y[0], p.z[1] - p.z[0]};
+        Vec3f dy{p.x[2] - p.x[0], p.y[2] - p.y[0], p.z[2] - p.z[0]};
+        // Scaled up so that planes a few degrees apart get different colors,
+        // none of them the black background.
+        Vec3f n = normalize(cross(dx, dy)) * 32.f + Vec3f{40.3f, 40.3f, 40.3f};
+        out.r.fill(0.25f + 0.75f * (n.x - std::floor(n.x)));
+        out.g.fill(0.25f + 0.75f * (n.y - std::floor(n.y)));
+        out.b.fill(0.25f + 0.75f * (n.z - std::floor(n.z)));
+    }
+};
+
+// Clip-space correction for rendering at twice the size: pixel centers map to
+// the centers of their 2x2 blocks, which the (size - 1) viewport scale
+// otherwise shifts by up to half a pixel across the frame.
+Mat4f supersample_alignment(int width, int height) {
+    float sx = 2.f * static_cast<float>(width - 1) / static_cast<float>(2 * width - 1);
+    float sy = 2.f * static_cast<float>(height - 1) / static_cast<float>(2 * height - 1);
+    Mat4f align = Mat4f::identity();
+    align[0][0] = sx;
+    align[0][3] = sx - 1.f;
+    align[1][1] = sy;
+    align[1][3] = 1.f - sy;
+    return align;
+}
+
+// 2x2 box filter, rounded like the multisample resolve.
+Image downsample(const Image& large) {
+    Image small(large.width() / 2, large.height() / 2);
+    size_t stride = static_cast<size_t>(large.width()) * 3;
+    for (int y = 0; y < small.height(); ++y) {
+        for (int x = 0; x < small.width(); ++x) {
+            const uint8_t* top = large.data() + static_cast<size_t>(2 * y) * stride + static_cast<size_t>(2 * x) * 3;
+            const uint8_t* bottom = top + stride;
+            uint8_t* out = small.data() + (static_cast<size_t>(y) * small.width() + x) * 3;
+            for (int c = 0; c < 3; ++c) {
+                out[c] = static_cast<uint8_t>((top[c] + top[3 + c] + bottom[c] + bottom[3 + c] + 2) >> 2);
+            }
+        }
+    }
+    return small;
+}
+
+int max_channel_diff(const uint8_t* a, const uint8_t* b) {
+    int diff = 0;
+    for (int c = 0; c < 3; ++c) {
+        diff = std::max(diff, std::abs(static_cast<int>(a[c]) - b[c]));
+    }
+    return diff;
+}
+
+// Checks a 4x multisampled render against the golden and a 2x supersampled
+// reference. Edge pixels, whose samples see more than one triangle plane,
+// must land within kEdgeTolerance of the reference, but for 1% where the
+// rotated and the ordered sample grids catch thin features differently;
+// every other pixel must match the golden. Silhouette pixels, partly
+// covered by the model, must mostly change and be closer to the reference
+// on average than the aliased golden.
+bool check_msaa(const Options& options,
+                const std::string& name,
+                JobSystem& jobs,
+                const Model& model,
+                const PhongShader& shader,
+                const Image& msaa,
+                const Image& golden) {
+    constexpr int kEdgeTolerance = 64;
+    Rasterizer coverage(kWidth, kHeight);
+    coverage.set_job_system(&jobs);
+    coverage.set_sample_count(4);
+    CoverageShader coverage_shader(shader);
+    coverage.render(model, coverage_shader);
+    FacetShader facet_shader(shader);
+    Rasterizer facets(kWidth, kHeight);
+    facets.set_job_system(&jobs);
+    facets.render(model, facet_shader);
+    Rasterizer msaa_facets(kWidth, kHeight);
+    msaa_facets.set_job_system(&jobs);
+    msaa_facets.set_sample_count(4);
+    msaa_facets.render(model, facet_shader);
+
+    PhongShader large_shader = shader;
+    large_shader.set_matrices(Mat4f::identity(), shader.view_matrix(),
+                              supersample_alignment(kWidth, kHeight) * shader.projection_matrix());
+    Rasterizer large(2 * kWidth, 2 * kHeight);
+    large.set_job_system(&jobs);
+    large.render(model, large_shader);
+    Image reference = downsample(large.image());
+
+    Image interior_msaa = msaa;
+    Image interior_golden = golden;
+    size_t edges = 0;
+    size_t silhouette = 0;
+    size_t changed = 0;
+    size_t far_off = 0;
+    int worst = 0;
+    uint64_t msaa_error = 0;
+    uint64_t aliased_error = 0;
+    for (size_t i = 0; i < golden.byte_size(); i += 3) {
+        if (max_channel_diff(msaa_facets.image().data() + i, facets.image().data() + i) == 0) {
+            continue;
+        }
+        ++edges;
+        int diff = max_channel_diff(msaa.data() + i, reference.data() + i);
+        far_off += diff > kEdgeTolerance ? 1 : 0;
+        worst = std::max(worst, diff);
+        std::fill(interior_msaa.data() + i, interior_msaa.data() + i + 3, uint8_t{0});
+        std::fill(interior_golden.data() + i, interior_golden.data() + i + 3, uint8_t{0});
+        uint8_t covered = coverage.image().data()[i];
+        if (covered == 0 || covered == 255) {
+            continue;
+        }
+        ++silhouette;
+        changed += max_channel_diff(msaa.data() + i, golden.data() + i) > options.tolerance ? 1 : 0;
+        msaa_error += static_cast<uint64_t>(diff);
+        aliased_error += static_cast<uint64_t>(max_channel_diff(golden.data() + i, reference.data() + i));
+    }
+    bool ok = check_image(options, name + "_msaa_inside", interior_msaa, interior_golden);
+    bool edges_ok = silhouette > 0 && changed * 2 >= silhouette && far_off * 100 <= edges &&
+                    msaa_error < aliased_error;
+    double per_pixel = 1.0 / static_cast<double>(std::max<size_t>(1, silhouette));
+    report(name + "_msaa_edges", edges_ok)
+        << "  " << far_off << " of " << edges << " edges off the 2x reference (worst " << worst << "), " << changed
+        << " of " << silhouette << " silhouette pixels changed, error " << std::fixed << std::setprecision(1)
+        << static_cast<double>(msaa_error) * per_pixel << " vs " << static_cast<double>(aliased_error) * per_pixel
+        << " aliased" << std::defaultfloat << std::endl;
+    return ok && edges_ok;
+}
+
+// Coarse shading against the golden. Full rate must match it exactly; the
+// coarse modes must shade fewer fragments, keep the mean pixel difference
+// under kMeanTolerance and leave at most kFarFraction of the pixels more than
+// kFarTolerance off. 4x4 blocks are aligned to the frame, so regions that
+// split the frame off the block grid must assemble to the full 4x4 image.
+bool check_vrs(const Options& options,
+               const std::string& name,
+               JobSystem& jobs,
+               const Model& model,
+               PhongShader& shader,
+               const Image& golden) {
+    constexpr double kMeanTolerance = 3.0;
+    constexpr int kFarTolerance = 48;
+    constexpr double kFarFraction = 0.02;
+    bool passed = true;
+    uint64_t full_fragments = 0;
+    Image coarse_4x4(1, 1);
+    for (ShadingRateMode mode : {ShadingRateMode::Full, ShadingRateMode::Coarse2x2, ShadingRateMode::Coarse4x4,
+                                 ShadingRateMode::Adaptive}) {
+        Rasterizer vrs(kWidth, kHeight);
+        vrs.set_job_system(&jobs);
+        ShadingRateConfig shading_rate;
+        shading_rate.mode = mode;
+        vrs.set_shading_rate(shading_rate);
+        uint64_t fragments = vrs.render(model, shader).fragments_shaded;
+        std::string label = name + "_vrs_" + shading_rate_mode_name(mode);
+        if (mode == ShadingRateMode::Full) {
+            full_fragments = fragments;
+            Options exact = options;
+            exact.tolerance = 0;
+            passed &= check_image(exact, label, vrs.image(), golden);
+            continue;
+        }
+        if (mode == ShadingRateMode::Coarse4x4) {
+            coarse_4x4 = vrs.image();
+        }
+        uint64_t total_diff = 0;
+        size_t far_off = 0;
+        for (size_t i = 0; i < golden.byte_size(); i += 3) {
+            int diff = max_channel_diff(vrs.image().data() + i, golden.data() + i);
+            total_diff += static_cast<uint64_t>(diff);
+            far_off += diff > kFarTolerance ? 1 : 0;
+        }
+        size_t pixels = golden.byte_size() / 3;
+        double mean = static_cast<double>(total_diff) / static_cast<double>(pixels);
+        bool ok = fragments < full_fragments && mean <= kMeanTolerance &&
+                  static_cast<double>(far_off) <= kFarFraction * static_cast<double>(pixels);
+        report(label, ok) << "  mean diff " << std::fixed << std::setprecision(2) << mean << std::defaultfloat
+                          << ", " << far_off << " pixels over " << kFarTolerance << ", " << fragments << " of "
+                          << full_fragments << " fragments shaded" << std::endl;
+        passed &= ok;
+    }
+
+    std::vector<RegionImage> parts;
+    for (const RenderRegion& region : split_frame(kWidth, kHeight, 3, 2)) {
+        Rasterizer part(region);
+        part.set_job_system(&jobs);
+        ShadingRateConfig shading_rate;
+        shading_rate.mode = ShadingRateMode::Coarse4x4;
+        part.set_shading_rate(shading_rate);
+        part.render(model, shader);
+        parts.push_back({region, part.image()});
+    }
+    Options exact = options;
+    exact.tolerance = 0;
+    passed &= check_image(exact, name + "_vrs_regions", assemble_regions(kWidth, kHeight, parts), coarse_4x4);
+    return passed;
+}
+
+// A grid of 120 heads, over 2^18 triangles, which render(const Scene&)
+// must split into several passes. The reference is the same grid merged into
+// one model and rendered in a single pass. The arena's peak must outlast the
+// passes: the last pass is the smallest, so the peak stays above its bytes.
+bool check_scene_passes(const Options& options, JobSystem& jobs) {
+    constexpr int kInstances = 120;
+    Model head("models/african_head.obj");
+    Scene grid;
+    frame_instances(grid, head, kInstances, kWidth, kHeight);
+    std::vector<Mat4f> transforms;
+    for (const DrawItem& draw : grid.draws()) {
+        transforms.insert(transforms.end(), draw.instances.begin(), draw.instances.end());
+    }
+    Scene scene;
+    scene.shading() = grid.shading();
+    scene.add(head, transforms, grid.shading().material());
+
+    // The instances are translations, so normals carry over unchanged.
+    std::vector<Vec3f> vertices;
+    std::vector<Vec3f> normals;
+    std::vector<Model::Face> faces;
+    for (const Mat4f& transform : transforms) {
+        int vertex_base = static_cast<int>(vertices.size());
+        int normal_base = static_cast<int>(normals.size());
+        for (const Vec3f& vertex : head.vertices()) {
+            vertices.push_back(transform_point(transform, vertex));
+        }
+        normals.insert(normals.end(), head.normals().begin(), head.normals().end());
+        for (size_t f = 0; f < head.face_count(); ++f) {
+            Model::Face face;
+            for (int i = 0; i < 3; ++i) {
+                face.vertex_ids[i] = head.face_vertex_indices(f)[i] + vertex_base;
+                face.normal_ids[i] = head.face_normal_indices(f)[i] + normal_base;
+            }
+            faces.push_back(face);
+        }
+    }
+    Model merged(std::move(vertices), std::move(normals), std::move(faces));
+    PhongShader shader = scene.shading();
+    Rasterizer single(kWidth, kHeight);
+    single.set_job_system(&jobs);
+    single.render(merged, shader);
+
+    Rasterizer passes(kWidth, kHeight);
+    passes.set_job_system(&jobs);
+    RenderStats stats = passes.render(scene);
+    FrameArenaStats memory = passes.memory_stats();
+    bool ok = stats.scene_passes > 1 && memory.peak_frame_bytes > memory.frame_bytes;
+    report("heads_arena", ok) << "  " << scene.triangle_count() << " triangles in " << stats.scene_passes
+                              << " passes, peak " << memory.peak_frame_bytes << " bytes, last pass "
+                              << memory.frame_bytes << " bytes" << std::endl;
+    return check_image(options, "heads_passes", passes.image(), single.image()) && ok;
+}
+
+// Pixels of a z-fight scene where the farther of two planes shows through.
+// Both face the eye 600 units out, 0.5 apart, seen at a 30 degree pitch with
+// near and far planes at 0.01 and 1000. There standard depth separates them
+// by less than one float step; reversed Z keeps thousands of steps between.
+size_t far_plane_fights(JobSystem& jobs, DepthFormat format) {
+    Model quad({{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}},
+               {{0.f, 0.f, 1.f}},
+               {Model::Face{{0, 1, 2}, {0, 0, 0}}, Model::Face{{0, 2, 3}, {0, 0, 0}}});
+    Camera camera({0.f, 0.f, 0.f},
+                  {0.f, -0.57735f, -1.f},
+                  {0.f, 1.f, 0.f},
+                  45.f,
+                  static_cast<float>(kWidth) / static_cast<float>(kHeight),
+                  0.01f,
+                  1000.f);
+    camera.set_reversed_z(format == DepthFormat::ReversedFloat32);
+    Scene scene;
+    scene.shading().set_matrices(Mat4f::identity(), camera.view_matrix(), camera.projection_matrix());
+    scene.shading().set_view_position(camera.position());
+    Material near_material{{0.8f, 0.2f, 0.2f}, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}, 1.f};
+    Material far_material{{0.2f, 0.2f, 0.8f}, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}, 1.f};
+    Vec3f size{1000.f, 1000.f, 1.f};
+    // Drawn first, so equal depths keep the near plane.
+    scene.add(quad, {Mat4f::translation({0.f, 0.f, -600.f}) * Mat4f::scale(size)}, near_material);
+
+    Rasterizer near_only(kWidth, kHeight);
+    near_only.set_job_system(&jobs);
+    near_only.set_depth_format(format);
+    near_only.render(scene);
+
+    scene.add(quad, {Mat4f::translation({0.f, 0.f, -600.5f}) * Mat4f::scale(size)}, far_material);
+    Rasterizer both(kWidth, kHeight);
+    both.set_job_system(&jobs);
+    both.set_depth_format(format);
+    both.render(scene);
+    return compare(both.image(), near_only.image(), 0).bad_pixels;
+}
+
+// The plane pair must fight with standard depth, or the scene tests nothing,
+// and must not with reversed Z.
+bool check_far_plane(JobSystem& jobs) {
+    size_t standard = far_plane_fights(jobs, DepthFormat::Float32);
+    size_t reversed = far_plane_fights(jobs, DepthFormat::ReversedFloat32);
+    bool ok = standard > 0 && reversed == 0;
+    report("far_plane_fight", ok) << "  " << standard << " pixels fight with standard depth, " << reversed
+                                  << " reversed" << std::endl;
+    return ok;
+}
+}
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parse_options(argc, argv);
+        std::filesystem::create_directories(options.out_dir);
+        if (options.update_golden) {
+            std::filesystem::create_directories(options.golden_dir);
+        }
+
+        JobSystemConfig config;
+        config.worker_count = options.threads;
+        JobSystem jobs(config);
+        std::map<std::string, double> baseline;
+        bool check_timings = !options.update_baseline;
+        if (check_timings && !options.baseline_path.empty()) {
+            baseline = read_baseline(options.baseline_path);
+        }
+        // Timed stages with no baseline entry, so never checked.
+        std::vector<std::string> unchecked;
+        std::ostringstream new_baseline;
+        new_baseline << std::fixed << std::setprecision(4);
+
+        bool passed = true;
+        for (const SceneCase& scene : kScenes) {
+            std::cout << scene.name << std::endl;
+            Model model = scene.synthetic ? make_synthetic(scene.source) : Model(scene.source);
+            PhongShader shader;
+            frame_model(shader, model, kWidth, kHeight);
+
+            Rasterizer serial(kWidth, kHeight);
+            serial.render(model, shader);
+
+            Rasterizer parallel(kWidth, kHeight);
+            parallel.set_job_system(&jobs);
+            std::vector<std::vector<double>> timings(std::size(kTimedStages));
+            for (int run = 0; run < options.runs; ++run) {
+                std::vector<double> values = stage_values(parallel.render(model, shader));
+                for (size_t stage = 0; stage < values.size(); ++stage) {
+                    timings[stage].push_back(values[stage]);
+                }
+            }
+
+            std::string golden_path = options.golden_dir + "/" + scene.name + ".ppm";
+            if (options.update_golden) {
+                if (!write_ppm(golden_path, serial.image())) {
+                    throw std::runtime_error("Failed to write " + golden_path);
+                }
+                std::cout << "  wrote " << golden_path << std::endl;
+            }
+            Image golden(1, 1);
+            if (!read_ppm(golden_path, golden)) {
+                std::cout << "  FAIL  missing golden image " << golden_path << std::endl;
+                passed = false;
+                continue;
+            }
+            passed &= check_image(options, std::string(scene.name) + "_serial", serial.image(), golden);
+            passed &= check_image(options, std::string(scene.name) + "_parallel", parallel.image(), golden);
+            for (FramebufferLayout layout : {FramebufferLayout::Tiled, FramebufferLayout::Morton}) {
+                Rasterizer tiled(kWidth, kHeight);
+                tiled.set_job_system(&jobs);
+                tiled.set_framebuffer_layout(layout);
+                tiled.render(model, shader);
+                passed &= check_image(options, std::string(scene.name) + "_" + framebuffer_layout_name(layout),
+                                      tiled.image(), golden);
+            }
+            // Unorm16 is lossy by design and resolves some near-coplanar surfaces differently.
+            PhongShader reversed_shader;
+            frame_model(reversed_shader, model, kWidth, kHeight, 1.f, true);
+            for (DepthFormat format : {DepthFormat::ReversedFloat32, DepthFormat::Unorm24}) {
+                Rasterizer depth(kWidth, kHeight);
+                depth.set_job_system(&jobs);
+                depth.set_depth_format(format);
+                depth.render(model, format == DepthFormat::ReversedFloat32 ? reversed_shader : shader);
+                passed &= check_image(options, std::string(scene.name) + "_" + depth_format_name(format),
+                                      depth.image(), golden);
+            }
+            Rasterizer sorted(kWidth, kHeight);
+            sorted.set_job_system(&jobs);
+            sorted.set_draw_order(DrawOrder::FrontToBack);
+            sorted.render(model, shader);
+            passed &= check_image(options, std::string(scene.name) + "_f2b", sorted.image(), golden);
+            Rasterizer prepass(kWidth, kHeight);
+            prepass.set_job_system(&jobs);
+            prepass.set_depth_prepass(true);
+            prepass.render(model, shader);
+            passed &= check_image(options, std::string(scene.name) + "_prepass", prepass.image(), golden);
+            Rasterizer occlusion(kWidth, kHeight);
+            occlusion.set_job_system(&jobs);
+            occlusion.set_occlusion_culling({true});
+            occlusion.render(model, shader);
+            passed &= check_image(options, std::string(scene.name) + "_occlusion", occlusion.image(), golden);
+            Rasterizer clusters(kWidth, kHeight);
+            clusters.set_job_system(&jobs);
+            clusters.set_cluster_culling(scene.closed ? ClusterCulling::FrustumCone : ClusterCulling::Frustum);
+            clusters.render(model, shader);
+            passed &= check_image(options, std::string(scene.name) + "_clusters", clusters.image(), golden);
+            // A scene of the model at identity plus a second draw far outside
+            // the view, which instance culling drops.
+            Scene instanced;
+            instanced.shading() = shader;
+            instanced.add(model, {Mat4f::identity()}, shader.material());
+            float away = 100.f * model.bounding_sphere().radius;
+            instanced.add(model, {Mat4f::translation({away, 0.f, 0.f})}, Material{});
+            Rasterizer scene_raster(kWidth, kHeight);
+            scene_raster.set_job_system(&jobs);
+            scene_raster.set_cluster_culling(ClusterCulling::Frustum);
+            scene_raster.render(instanced);
+            passed &= check_image(options, std::string(scene.name) + "_scene", scene_raster.image(), golden);
+
+            // Every layout must resolve to the same multisampled image.
+            Rasterizer msaa(kWidth, kHeight);
+            msaa.set_job_system(&jobs);
+            msaa.set_sample_count(4);
+            msaa.render(model, shader);
+            Rasterizer msaa_morton(kWidth, kHeight);
+            msaa_morton.set_job_system(&jobs);
+            msaa_morton.set_sample_count(4);
+            msaa_morton.set_framebuffer_layout(FramebufferLayout::Morton);
+            msaa_morton.render(model, shader);
+            passed &= check_image(options, std::string(scene.name) + "_msaa", msaa_morton.image(), msaa.image());
+            passed &= check_msaa(options, scene.name, jobs, model, shader, msaa.image(), golden);
+            passed &= check_vrs(options, scene.name, jobs, model, shader, golden);
+
+            std::vector<RegionImage> parts;
+            for (const RenderRegion& region : split_frame(kWidth, kHeight, 3, 2)) {
+                Rasterizer part(region);
+                part.set_job_system(&jobs);
+                part.render(model, shader);
+                parts.push_back({region, part.image()});
+            }
+            passed &= check_image(options, std::string(scene.name) + "_regions",
+                                  assemble_regions(kWidth, kHeight, parts), golden);
+
+            Image banded(kWidth, kHeight);
+            FrameRowSink sink(banded);
+            Rasterizer bands(RenderRegion{kWidth, kHeight, 0, 0, kWidth, 40});
+            bands.set_job_system(&jobs);
+            bands.render_bands(model, shader, sink);
+            passed &= check_image(options, std::string(scene.name) + "_bands", banded, golden);
+
+            // Bands streamed to a PNG and decoded again. Bands of 24 rows give
+            // one IDAT per band; the rows do not end on byte boundaries, so
+            // bits carry from one IDAT to the next.
+            std::string stream_path = options.out_dir + "/" + scene.name + "_stream.png";
+            PngStreamWriter png;
+            if (!png.open(stream_path, kWidth, kHeight)) {
+                throw std::runtime_error("Failed to open " + stream_path);
+            }
+            Rasterizer streamed(RenderRegion{kWidth, kHeight, 0, 0, kWidth, 24});
+            streamed.set_job_system(&jobs);
+            streamed.render_bands(model, shader, png);
+            Image decoded(1, 1);
+            if (!png.finish() || !read_png(stream_path, decoded)) {
+                std::cout << "  FAIL  could not write or decode " << stream_path << std::endl;
+                passed = false;
+            } else {
+                passed &= check_image(options, std::string(scene.name) + "_png", decoded, golden);
+            }
+
+            MultiProcessConfig mp_config;
+            mp_config.processes = 3;
+            mp_config.threads_per_process = 2;
+            MultiProcessRenderer processes(kWidth, kHeight, mp_config);
+            processes.render(model, shader);
+            passed &= check_image(options, std::string(scene.name) + "_processes", processes.image(), golden);
+
+            for (size_t stage = 0; stage < timings.size(); ++stage) {
+                std::string key = std::string(scene.name) + " " + kTimedStages[stage];
+                double ms = median(timings[stage]);
+                new_baseline << key << " " << ms << "\n";
+                auto it = baseline.find(key);
+                if (it == baseline.end()) {
+                    unchecked.push_back(key);
+                    continue;
+                }
+                double limit = std::max(it->second * (1.0 + options.threshold), it->second + options.min_delta_ms);
+                if (ms > limit) {
+                    std::cout << "  FAIL  " << kTimedStages[stage] << " regressed: " << std::fixed
+                              << std::setprecision(3) << ms << " ms vs baseline " << it->second << " ms" << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        std::cout << "depth" << std::endl;
+        passed &= check_far_plane(jobs);
+        std::cout << "passes" << std::endl;
+        passed &= check_scene_passes(options, jobs);
+
+        if (options.update_baseline && !options.baseline_path.empty()) {
+            std::ofstream out(options.baseline_path);
+            out << new_baseline.str();
+            std::cout << "Wrote timing baseline " << options.baseline_path << std::endl;
+        } else {
+            std::ofstream(options.out_dir + "/timings.txt") << new_baseline.str();
+        }
+        if (check_timings && !unchecked.empty()) {
+            std::string from = options.baseline_path.empty() ? "no --baseline given" : options.baseline_path;
+            std::cerr << "WARNING: timings NOT checked for " << unchecked.size() << " stages, starting with \""
+                      << unchecked.front() << "\" (" << from << "); record a baseline with --update-baseline"
+                      << std::endl;
+            if (options.require_baseline) {
+                passed = false;
+            }
+        }
+        std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+        return passed ? 0 : 1;
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+}
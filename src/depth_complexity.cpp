@@ -0,0 +1,96 @@
+#include "depth_complexity.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+namespace {
+Vec3f heat_color(float t) {
+    static const std::array<Vec3f, 5> stops = {{
+        {0.f, 0.f, 0.f},
+        {0.f, 0.f, 1.f},
+        {0.f, 1.f, 0.f},
+        {1.f, 1.f, 0.f},
+        {1.f, 0.f, 0.f},
+    }};
+    t = clamp(t, 0.f, 1.f) * static_cast<float>(stops.size() - 1);
+    size_t lower = std::min(static_cast<size_t>(t), stops.size() - 2);
+    float frac = t - static_cast<float>(lower);
+    return stops[lower] * (1.f - frac) + stops[lower + 1] * frac;
+}
+}
+
+void DepthComplexity::reset(int width, int height) {
+    width_ = width;
+    height_ = height;
+    size_t count = static_cast<size_t>(width) * height;
+    tested_.assign(count, 0);
+    passed_.assign(count, 0);
+    shaded_.assign(count, 0);
+}
+
+uint32_t* DepthComplexity::data(ComplexityChannel channel) {
+    return const_cast<uint32_t*>(this->channel(channel).data());
+}
+
+const std::vector<uint32_t>& DepthComplexity::channel(ComplexityChannel channel) const {
+    switch (channel) {
+    case ComplexityChannel::Tested:
+        return tested_;
+    case ComplexityChannel::Passed:
+        return passed_;
+    case ComplexityChannel::Shaded:
+        break;
+    }
+    return shaded_;
+}
+
+uint32_t DepthComplexity::max_value(ComplexityChannel channel) const {
+    const auto& values = this->channel(channel);
+    return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
+
+std::vector<uint64_t> DepthComplexity::histogram(ComplexityChannel channel) const {
+    std::vector<uint64_t> bins(static_cast<size_t>(max_value(channel)) + 1, 0);
+    for (uint32_t value : this->channel(channel)) {
+        ++bins[value];
+    }
+    return bins;
+}
+
+Image DepthComplexity::heatmap(ComplexityChannel channel, uint32_t scale_max) const {
+    Image image(width_, height_);
+    uint32_t top = scale_max > 0 ? scale_max : std::max<uint32_t>(1, max_value(channel));
+    const auto& values = this->channel(channel);
+    for (int y = 0; y < height_; ++y) {
+        for (int x = 0; x < width_; ++x) {
+            uint32_t value = values[static_cast<size_t>(y) * width_ + x];
+            Vec3f color = value == 0 ? Vec3f{} : heat_color(static_cast<float>(value) / static_cast<float>(top));
+            image.set_pixel(x, y, color);
+        }
+    }
+    return image;
+}
+
+bool DepthComplexity::write_heatmap_png(const std::string& path,
+                                        ComplexityChannel channel,
+                                        uint32_t scale_max) const {
+    return heatmap(channel, scale_max).write_png(path);
+}
+
+bool DepthComplexity::write_histogram_csv(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    auto tested = histogram(ComplexityChannel::Tested);
+    auto passed = histogram(ComplexityChannel::Passed);
+    auto shaded = histogram(ComplexityChannel::Shaded);
+    size_t rows = std::max({tested.size(), passed.size(), shaded.size()});
+    auto at = [](const std::vector<uint64_t>& bins, size_t i) { return i < bins.size() ? bins[i] : 0; };
+    out << "count,tested,passed,shaded\n";
+    for (size_t i = 0; i < rows; ++i) {
+        out << i << ',' << at(tested, i) << ',' << at(passed, i) << ',' << at(shaded, i) << '\n';
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,117 @@
+#include "frame_arena.hpp"
+
+#include <algorithm>
+
+LinearAllocator::LinearAllocator(size_t block_size) : block_size_(block_size) {}
+
+void* LinearAllocator::allocate(size_t bytes, size_t alignment) {
+    while (current_ < blocks_.size()) {
+        Block& block = blocks_[current_];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+        uintptr_t aligned = (base + offset_ + alignment - 1) & ~(uintptr_t{alignment} - 1);
+        size_t end = static_cast<size_t>(aligned - base) + bytes;
+        if (end <= block.size) {
+            used_ += end - offset_;
+            offset_ = end;
+            return reinterpret_cast<void*>(aligned);
+        }
+        ++current_;
+        offset_ = 0;
+    }
+
+    Block block;
+    block.size = std::max(block_size_, bytes + alignment);
+    block.data = std::make_unique<std::byte[]>(block.size);
+    reserved_ += block.size;
+    blocks_.push_back(std::move(block));
+    current_ = blocks_.size() - 1;
+    offset_ = 0;
+    return allocate(bytes, alignment);
+}
+
+void LinearAllocator::reset() {
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+PoolAllocator::PoolAllocator(size_t chunk_size, size_t chunks_per_block)
+    : chunk_size_(std::max(sizeof(FreeNode), (chunk_size + alignof(std::max_align_t) - 1) &
+                                                 ~(alignof(std::max_align_t) - 1))),
+      chunks_per_block_(std::max<size_t>(1, chunks_per_block)) {}
+
+void* PoolAllocator::allocate() {
+    ++live_;
+    if (free_list_) {
+        FreeNode* node = free_list_;
+        free_list_ = node->next;
+        return node;
+    }
+    if (current_ < blocks_.size() && next_chunk_ == chunks_per_block_) {
+        ++current_;
+        next_chunk_ = 0;
+    }
+    if (current_ == blocks_.size()) {
+        blocks_.push_back(std::make_unique<std::byte[]>(chunk_size_ * chunks_per_block_));
+        next_chunk_ = 0;
+    }
+    return blocks_[current_].get() + chunk_size_ * next_chunk_++;
+}
+
+void PoolAllocator::release(void* chunk) {
+    auto* node = static_cast<FreeNode*>(chunk);
+    node->next = free_list_;
+    free_list_ = node;
+    --live_;
+}
+
+void PoolAllocator::reset() {
+    current_ = 0;
+    next_chunk_ = 0;
+    free_list_ = nullptr;
+    live_ = 0;
+}
+
+FrameArena::FrameArena(size_t bin_chunk_size, int worker_count) : bin_chunk_size_(bin_chunk_size) {
+    set_worker_count(worker_count);
+}
+
+void FrameArena::set_worker_count(int worker_count) {
+    size_t count = static_cast<size_t>(std::max(1, worker_count));
+    while (workers_.size() < count) {
+        workers_.push_back(std::make_unique<WorkerArena>(bin_chunk_size_));
+    }
+    workers_.resize(count);
+}
+
+void FrameArena::begin_frame() {
+    FrameArenaStats current = stats();
+    peak_frame_bytes_ = std::max(peak_frame_bytes_, current.frame_bytes);
+    peak_bin_chunks_ = std::max(peak_bin_chunks_, current.bin_chunks);
+    for (auto& worker : workers_) {
+        worker->linear.reset();
+        worker->bins.reset();
+    }
+}
+
+void FrameArena::reset_bins() {
+    FrameArenaStats current = stats();
+    peak_frame_bytes_ = std::max(peak_frame_bytes_, current.frame_bytes);
+    peak_bin_chunks_ = std::max(peak_bin_chunks_, current.bin_chunks);
+    for (auto& worker : workers_) {
+        worker->bins.reset();
+    }
+}
+
+FrameArenaStats FrameArena::stats() const {
+    FrameArenaStats result;
+    for (const auto& worker : workers_) {
+        result.frame_bytes += worker->linear.used_bytes() +
+                              worker->bins.live_chunks() * worker->bins.chunk_size();
+        result.reserved_bytes += worker->linear.reserved_bytes() + worker->bins.reserved_bytes();
+        result.bin_chunks += worker->bins.live_chunks();
+    }
+    result.peak_frame_bytes = std::max(peak_frame_bytes_, result.frame_bytes);
+    result.peak_bin_chunks = std::max(peak_bin_chunks_, result.bin_chunks);
+    return result;
+}
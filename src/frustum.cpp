@@ -0,0 +1,52 @@
+#include "frustum.hpp"
+
+#include <cmath>
+
+// Gribb-Hartmann: the clip volume is -w <= x, y, z <= w, so each plane is
+// row 3 plus or minus row 0, 1 or 2 of the transform. With reversed Z the
+// near plane is z <= w and the far plane z >= 0, row 2 alone.
+Frustum Frustum::from_matrix(const Mat4f& clip_transform, bool reversed_z) {
+    Frustum frustum;
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            float sign = side ? -1.f : 1.f;
+            float w_weight = 1.f;
+            if (reversed_z && axis == 2) {
+                sign = -sign;
+                w_weight = side ? 0.f : 1.f;
+            }
+            const auto& w = clip_transform[3];
+            const auto& row = clip_transform[axis];
+            Vec4f plane{w_weight * w[0] + sign * row[0], w_weight * w[1] + sign * row[1],
+                        w_weight * w[2] + sign * row[2], w_weight * w[3] + sign * row[3]};
+            float len = length(Vec3f{plane.x, plane.y, plane.z});
+            // A degenerate plane rejects nothing.
+            frustum.planes[axis * 2 + side] = len > 0.f
+                                                  ? Vec4f{plane.x / len, plane.y / len, plane.z / len, plane.w / len}
+                                                  : Vec4f{0.f, 0.f, 0.f, 1.f};
+        }
+    }
+    return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+    for (const Vec4f& plane : planes) {
+        if (dot(sphere.center, Vec3f{plane.x, plane.y, plane.z}) + plane.w < -sphere.radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Frustum::intersects(const Aabb& box) const {
+    Vec3f center = box.center();
+    Vec3f extent = box.extent();
+    for (const Vec4f& plane : planes) {
+        float distance = dot(center, Vec3f{plane.x, plane.y, plane.z}) + plane.w;
+        float reach = dot(extent, Vec3f{std::abs(plane.x), std::abs(plane.y), std::abs(plane.z)});
+        if (distance + reach < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
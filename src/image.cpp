@@ -1,19 +1,93 @@
 #include "image.hpp"
 
+#include <algorithm>
+#include <cstring>
+
+#include "trace.hpp"
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+namespace {
+void append_bytes(void* context, void* data, int size) {
+    auto* out = static_cast<std::vector<uint8_t>*>(context);
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    out->insert(out->end(), bytes, bytes + size);
+}
+}
+
 Image::Image(int width, int height)
-    : width_(width), height_(height), pixels_(static_cast<size_t>(width) * height * 3, 0) {}
+    : width_(width), height_(height), storage_(static_cast<size_t>(width) * height * 3, 0), data_(storage_.data()) {}
+
+Image Image::view(int width, int height, uint8_t* pixels) {
+    Image image(0, 0);
+    image.width_ = width;
+    image.height_ = height;
+    image.data_ = pixels;
+    return image;
+}
+
+Image::Image(const Image& other)
+    : width_(other.width_),
+      height_(other.height_),
+      storage_(other.data_, other.data_ + other.byte_size()),
+      data_(storage_.data()) {}
+
+Image::Image(Image&& other) noexcept
+    : width_(other.width_), height_(other.height_), storage_(std::move(other.storage_)), data_(other.data_) {
+    other.width_ = 0;
+    other.height_ = 0;
+    other.data_ = nullptr;
+}
+
+Image& Image::operator=(const Image& other) {
+    if (this != &other) {
+        Image copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Image& Image::operator=(Image&& other) noexcept {
+    width_ = other.width_;
+    height_ = other.height_;
+    storage_ = std::move(other.storage_);
+    data_ = other.data_;
+    other.width_ = 0;
+    other.height_ = 0;
+    other.data_ = nullptr;
+    return *this;
+}
 
 void Image::clear(const Vec3f& color) {
-    const uint8_t r = static_cast<uint8_t>(clamp(color.x, 0.f, 1.f) * 255.f);
-    const uint8_t g = static_cast<uint8_t>(clamp(color.y, 0.f, 1.f) * 255.f);
-    const uint8_t b = static_cast<uint8_t>(clamp(color.z, 0.f, 1.f) * 255.f);
-    for (size_t i = 0; i < pixels_.size(); i += 3) {
-        pixels_[i] = r;
-        pixels_[i + 1] = g;
-        pixels_[i + 2] = b;
+    fill_rect(0, 0, width_, height_, color);
+}
+
+void Image::fill_rect(int x0, int y0, int x1, int y1, const Vec3f& color) {
+    x0 = std::max(0, x0);
+    y0 = std::max(0, y0);
+    x1 = std::min(width_, x1);
+    y1 = std::min(height_, y1);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    uint8_t rgb[3];
+    pack_rgb(color, rgb);
+    size_t stride = static_cast<size_t>(width_) * 3;
+    size_t span = static_cast<size_t>(x1 - x0) * 3;
+    uint8_t* first = data_ + static_cast<size_t>(y0) * stride + static_cast<size_t>(x0) * 3;
+    if (rgb[0] == rgb[1] && rgb[1] == rgb[2]) {
+        for (int y = y0; y < y1; ++y) {
+            std::memset(first + static_cast<size_t>(y - y0) * stride, rgb[0], span);
+        }
+        return;
+    }
+    // Build one row, then copy it down.
+    for (size_t i = 0; i < span; i += 3) {
+        std::memcpy(first + i, rgb, 3);
+    }
+    for (int y = y0 + 1; y < y1; ++y) {
+        std::memcpy(first + static_cast<size_t>(y - y0) * stride, first, span);
     }
 }
 
@@ -21,13 +95,33 @@ void Image::set_pixel(int x, int y, const Vec3f& color) {
     if (x < 0 || x >= width_ || y < 0 || y >= height_) {
         return;
     }
-    size_t index = (static_cast<size_t>(y) * width_ + x) * 3;
-    pixels_[index] = static_cast<uint8_t>(clamp(color.x, 0.f, 1.f) * 255.f);
-    pixels_[index + 1] = static_cast<uint8_t>(clamp(color.y, 0.f, 1.f) * 255.f);
-    pixels_[index + 2] = static_cast<uint8_t>(clamp(color.z, 0.f, 1.f) * 255.f);
+    pack_rgb(color, data_ + (static_cast<size_t>(y) * width_ + x) * 3);
+}
+
+void Image::blit(const Image& src, int x, int y) {
+    int src_x0 = std::max(0, -x);
+    int src_y0 = std::max(0, -y);
+    int src_x1 = std::min(src.width_, width_ - x);
+    int src_y1 = std::min(src.height_, height_ - y);
+    if (src_x0 >= src_x1) {
+        return;
+    }
+    for (int row = src_y0; row < src_y1; ++row) {
+        const uint8_t* from = src.data_ + (static_cast<size_t>(row) * src.width_ + src_x0) * 3;
+        uint8_t* to = data_ + (static_cast<size_t>(row + y) * width_ + src_x0 + x) * 3;
+        std::copy(from, from + static_cast<size_t>(src_x1 - src_x0) * 3, to);
+    }
 }
 
 bool Image::write_png(const std::string& path) const {
+    TRACE_SCOPE("Image::write_png");
+    int stride = width_ * 3;
+    return stbi_write_png(path.c_str(), width_, height_, 3, data_, stride) != 0;
+}
+
+bool Image::encode_png(std::vector<uint8_t>& out) const {
+    TRACE_SCOPE("Image::encode_png");
+    out.clear();
     int stride = width_ * 3;
-    return stbi_write_png(path.c_str(), width_, height_, 3, pixels_.data(), stride) != 0;
+    return stbi_write_png_to_func(append_bytes, &out, width_, height_, 3, data_, stride) != 0;
 }
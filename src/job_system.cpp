@@ -0,0 +1,301 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "trace.hpp"
+
+namespace {
+thread_local const JobSystem* tls_system = nullptr;
+thread_local int tls_worker = 0;
+// Wall time of the tasks the current task ran inline while waiting.
+thread_local uint64_t tls_nested_ns = 0;
+
+uint64_t now_ns() {
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+}
+
+JobSystem::JobSystem(JobSystemConfig config) : config_(std::move(config)) {
+    int count = config_.worker_count;
+    if (count <= 0) {
+        count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    workers_.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+#ifdef __linux__
+    if (config_.pin_threads) {
+        cpu_set_t previous;
+        CPU_ZERO(&previous);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &previous)) {
+                    caller_cpus_.push_back(cpu);
+                }
+            }
+        }
+        if (!caller_cpus_.empty()) {
+            pin_current_thread(0);
+        }
+    }
+#endif
+    threads_.reserve(static_cast<size_t>(count - 1));
+    for (int i = 1; i < count; ++i) {
+        threads_.emplace_back(&JobSystem::worker_main, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_.store(true);
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+#ifdef __linux__
+    if (!caller_cpus_.empty()) {
+        cpu_set_t previous;
+        CPU_ZERO(&previous);
+        for (int cpu : caller_cpus_) {
+            CPU_SET(cpu, &previous);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+    }
+#endif
+}
+
+int JobSystem::current_worker() const {
+    return tls_system == this ? tls_worker : 0;
+}
+
+JobSystem::TaskHandle JobSystem::submit(std::function<void()> fn,
+                                        const std::vector<TaskHandle>& dependencies) {
+    auto task = std::make_shared<Task>();
+    task->fn = std::move(fn);
+    task->unresolved.store(1 + static_cast<int>(dependencies.size()));
+    for (const auto& dep : dependencies) {
+        std::lock_guard<std::mutex> lock(dep->mutex);
+        if (dep->finished.load(std::memory_order_acquire)) {
+            task->unresolved.fetch_sub(1);
+        } else {
+            dep->dependents.push_back(task);
+        }
+    }
+    if (task->unresolved.fetch_sub(1) == 1) {
+        enqueue(task);
+    }
+    return task;
+}
+
+void JobSystem::wait(const TaskHandle& task) {
+    int index = current_worker();
+    while (!task->finished.load(std::memory_order_acquire)) {
+        if (!run_one(index)) {
+            std::this_thread::yield();
+        }
+    }
+    if (task->error) {
+        std::rethrow_exception(task->error);
+    }
+}
+
+void JobSystem::wait_all(const std::vector<TaskHandle>& tasks) {
+    std::exception_ptr first_error;
+    for (const auto& task : tasks) {
+        try {
+            wait(task);
+        } catch (...) {
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain, const RangeFn& fn) {
+    if (end <= begin) {
+        return;
+    }
+    grain = std::max<size_t>(1, grain);
+    if (workers_.size() == 1 || end - begin <= grain) {
+        fn(begin, end);
+        return;
+    }
+    std::vector<TaskHandle> tasks;
+    tasks.reserve((end - begin + grain - 1) / grain);
+    for (size_t chunk = begin; chunk < end; chunk += grain) {
+        size_t chunk_end = std::min(end, chunk + grain);
+        tasks.push_back(submit([&fn, chunk, chunk_end] { fn(chunk, chunk_end); }));
+    }
+    wait_all(tasks);
+}
+
+std::vector<WorkerStats> JobSystem::worker_stats() const {
+    std::vector<WorkerStats> result;
+    result.reserve(workers_.size());
+    for (const auto& worker : workers_) {
+        WorkerStats stats;
+        stats.tasks_executed = worker->tasks_executed.load();
+        stats.tasks_stolen = worker->tasks_stolen.load();
+        stats.busy_ns = worker->busy_ns.load();
+        stats.idle_ns = worker->idle_ns.load();
+        stats.cpu = worker->cpu.load();
+        result.push_back(stats);
+    }
+    return result;
+}
+
+void JobSystem::reset_stats() {
+    for (auto& worker : workers_) {
+        worker->tasks_executed.store(0);
+        worker->tasks_stolen.store(0);
+        worker->busy_ns.store(0);
+        worker->idle_ns.store(0);
+    }
+}
+
+void JobSystem::worker_main(int index) {
+    tls_system = this;
+    tls_worker = index;
+    if (config_.pin_threads) {
+        pin_current_thread(index);
+    }
+#ifdef SR_ENABLE_TRACE
+    if (Trace::enabled()) {
+        Trace::set_thread_name("worker " + std::to_string(index));
+    }
+#endif
+    Worker& self = *workers_[static_cast<size_t>(index)];
+    while (!stopping_.load()) {
+        if (run_one(index)) {
+            continue;
+        }
+        uint64_t idle_start = now_ns();
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stopping_.load() || queued_.load() > 0; });
+        }
+        self.idle_ns.fetch_add(now_ns() - idle_start, std::memory_order_relaxed);
+    }
+}
+
+void JobSystem::enqueue(TaskHandle task) {
+    Worker& worker = *workers_[static_cast<size_t>(current_worker())];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    if (!threads_.empty()) {
+        { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+        wake_.notify_one();
+    }
+}
+
+JobSystem::TaskHandle JobSystem::pop_task(int index) {
+    size_t count = workers_.size();
+    {
+        Worker& own = *workers_[static_cast<size_t>(index)];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            TaskHandle task = std::move(own.queue.back());
+            own.queue.pop_back();
+            queued_.fetch_sub(1);
+            return task;
+        }
+    }
+    for (size_t offset = 1; offset < count; ++offset) {
+        Worker& victim = *workers_[(static_cast<size_t>(index) + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            TaskHandle task = std::move(victim.queue.front());
+            victim.queue.pop_front();
+            queued_.fetch_sub(1);
+            workers_[static_cast<size_t>(index)]->tasks_stolen.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool JobSystem::run_one(int index) {
+    if (queued_.load() == 0) {
+        return false;
+    }
+    TaskHandle task = pop_task(index);
+    if (!task) {
+        return false;
+    }
+    execute(index, task);
+    return true;
+}
+
+void JobSystem::execute(int index, const TaskHandle& task) {
+    Worker& worker = *workers_[static_cast<size_t>(index)];
+    uint64_t outer_nested_ns = tls_nested_ns;
+    tls_nested_ns = 0;
+    uint64_t start = now_ns();
+    try {
+        task->fn();
+    } catch (...) {
+        task->error = std::current_exception();
+    }
+    task->fn = nullptr;
+    uint64_t elapsed = now_ns() - start;
+    // Nested tasks counted their own time; the enclosing task excludes all
+    // of this one's.
+    worker.busy_ns.fetch_add(elapsed - std::min(elapsed, tls_nested_ns), std::memory_order_relaxed);
+    tls_nested_ns = outer_nested_ns + elapsed;
+    worker.tasks_executed.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<TaskHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->finished.store(true, std::memory_order_release);
+        dependents.swap(task->dependents);
+    }
+    for (auto& dependent : dependents) {
+        if (dependent->unresolved.fetch_sub(1) == 1) {
+            enqueue(std::move(dependent));
+        }
+    }
+}
+
+bool JobSystem::pin_current_thread(int index) {
+#ifdef __linux__
+    const std::vector<int>& cpus = config_.cpu_ids.empty() ? caller_cpus_ : config_.cpu_ids;
+    if (cpus.empty()) {
+        return false;
+    }
+    int cpu = cpus[static_cast<size_t>(index) % cpus.size()];
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return false;
+    }
+    workers_[static_cast<size_t>(index)]->cpu.store(cpu);
+    return true;
+#else
+    (void)index;
+    return false;
+#endif
+}
@@ -1,54 +1,338 @@
-#include <exception>
-#include <iostream>
-
-#include "camera.hpp"
-#include "model.hpp"
-#include "rasterizer.hpp"
-#include "shader.hpp"
-
-int main() {
-    try {
-        const int width = 1024;
-        const int height = 1024;
-
-        Model model("models/Sponsa.obj");
-
-        Camera camera({0.f, 10.1f, 1.f},
-                      {0.f, -20.f, 0.f},
-                      {0.f, 1.f, 0.f},
-                      45.f,
-                      static_cast<float>(width) / static_cast<float>(height),
-                      0.1f,
-                      20.f);
-
-        Mat4f model_matrix = Mat4f::translation({0.f, -0.05f, 0.f}) *
-                             Mat4f::scale({1.4f, 1.4f, 1.4f});
-
-        PhongShader shader;
-        shader.set_matrices(model_matrix, camera.view_matrix(), camera.projection_matrix());
-        shader.set_light_direction(normalize(Vec3f{0.4f, 0.8f, 0.1f}));
-        shader.set_light_color({1.f, 0.96f, 0.9f});
-        shader.set_fill_light(normalize(Vec3f{-0.3f, 0.4f, -0.2f}), {0.45f, 0.5f, 0.6f});
-        shader.set_view_position(camera.position());
-        shader.set_material({0.15f, 0.1f, 0.08f},
-                            {0.7f, 0.5f, 0.45f},
-                            {0.4f, 0.35f, 0.3f},
-                            42.f);
-        shader.set_exposure(1.8f);
-
-        Rasterizer raster(width, height);
-        raster.render(model, shader);
-
-        if (!raster.write_png("output.png")) {
-            std::cerr << "Failed to write output.png" << std::endl;
-            return 1;
-        }
-
-        std::cout << "Rendered image saved to output.png" << std::endl;
-    } catch (const std::exception& ex) {
-        std::cerr << "Error: " << ex.what() << std::endl;
-        return 1;
-    }
-
-    return 0;
-}
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "camera.hpp"
+#include "job_system.hpp"
+#include "model.hpp"
+#include "multiprocess_renderer.hpp"
+#include "png_stream.hpp"
+#include "rasterizer.hpp"
+#include "shader.hpp"
+#include "trace.hpp"
+
+namespace {
+struct Options {
+    std::string model_path = "models/Sponsa.obj";
+    std::string output_path = "output.png";
+    int threads = 0;
+    int processes = 0;
+    int bucket_rows = 0;
+    FramebufferLayout layout = FramebufferLayout::Linear;
+    DepthFormat depth_format = DepthFormat::Float32;
+    int samples = 1;
+    ShadingRateMode shading_rate = ShadingRateMode::Full;
+    DrawOrder draw_order = DrawOrder::Submission;
+    bool depth_prepass = false;
+    bool occlusion_culling = false;
+    ClusterCulling cluster_culling = ClusterCulling::Off;
+    int width = 1024;
+    int height = 1024;
+    bool print_stats = false;
+    std::string stats_json_path;
+    std::string trace_path;
+    std::string heatmap_prefix;
+    bool has_region = false;
+    std::array<int, 4> region{};
+};
+
+std::array<int, 4> parse_region(const std::string& text) {
+    std::array<int, 4> values{};
+    std::stringstream stream(text);
+    std::string item;
+    for (int& value : values) {
+        if (!std::getline(stream, item, ',')) {
+            throw std::runtime_error("Expected --region x0,y0,x1,y1, got: " + text);
+        }
+        value = std::stoi(item);
+    }
+    return values;
+}
+
+std::array<int, 2> parse_size(const std::string& text) {
+    size_t split = text.find('x');
+    if (split == std::string::npos) {
+        throw std::runtime_error("Expected --size WIDTHxHEIGHT, got: " + text);
+    }
+    std::array<int, 2> size{std::stoi(text.substr(0, split)), std::stoi(text.substr(split + 1))};
+    if (size[0] <= 0 || size[1] <= 0) {
+        throw std::runtime_error("Image size must be positive: " + text);
+    }
+    return size;
+}
+
+// Flags set in options that --processes cannot honour: the worker
+// processes render the full frame with a default Rasterizer and report only
+// MultiProcessStats.
+std::vector<std::string> flags_without_processes(const Options& options) {
+    std::vector<std::string> flags;
+    if (options.has_region) {
+        flags.push_back("--region");
+    }
+    if (!options.heatmap_prefix.empty()) {
+        flags.push_back("--heatmap");
+    }
+    if (options.bucket_rows > 0) {
+        flags.push_back("--bucket-rows");
+    }
+    if (!options.stats_json_path.empty()) {
+        flags.push_back("--stats-json");
+    }
+    if (!options.trace_path.empty()) {
+        flags.push_back("--trace");
+    }
+    if (options.layout != FramebufferLayout::Linear) {
+        flags.push_back("--layout");
+    }
+    if (options.depth_format != DepthFormat::Float32) {
+        flags.push_back("--depth-format");
+    }
+    if (options.samples != 1) {
+        flags.push_back("--msaa");
+    }
+    if (options.shading_rate != ShadingRateMode::Full) {
+        flags.push_back("--shading-rate");
+    }
+    if (options.draw_order != DrawOrder::Submission) {
+        flags.push_back("--draw-order");
+    }
+    if (options.depth_prepass) {
+        flags.push_back("--depth-prepass");
+    }
+    if (options.occlusion_culling) {
+        flags.push_back("--occlusion-culling");
+    }
+    if (options.cluster_culling != ClusterCulling::Off) {
+        flags.push_back("--cluster-culling");
+    }
+    return flags;
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--model") {
+            options.model_path = value();
+        } else if (arg == "--output") {
+            options.output_path = value();
+        } else if (arg == "--threads") {
+            options.threads = std::stoi(value());
+        } else if (arg == "--size") {
+            std::array<int, 2> size = parse_size(value());
+            options.width = size[0];
+            options.height = size[1];
+        } else if (arg == "--layout") {
+            std::string name = value();
+            if (!parse_framebuffer_layout(name, options.layout)) {
+                throw std::runtime_error("Unknown framebuffer layout: " + name);
+            }
+        } else if (arg == "--depth-format") {
+            std::string name = value();
+            if (!parse_depth_format(name, options.depth_format)) {
+                throw std::runtime_error("Unknown depth format: " + name);
+            }
+        } else if (arg == "--msaa") {
+            options.samples = std::stoi(value());
+        } else if (arg == "--shading-rate") {
+            std::string name = value();
+            if (!parse_shading_rate_mode(name, options.shading_rate)) {
+                throw std::runtime_error("Unknown shading rate: " + name);
+            }
+        } else if (arg == "--occlusion-culling") {
+            options.occlusion_culling = true;
+        } else if (arg == "--cluster-culling") {
+            std::string name = value();
+            if (!parse_cluster_culling(name, options.cluster_culling)) {
+                throw std::runtime_error("Unknown cluster culling mode: " + name);
+            }
+        } else if (arg == "--depth-prepass") {
+            options.depth_prepass = true;
+        } else if (arg == "--draw-order") {
+            std::string name = value();
+            if (!parse_draw_order(name, options.draw_order)) {
+                throw std::runtime_error("Unknown draw order: " + name);
+            }
+        } else if (arg == "--bucket-rows") {
+            options.bucket_rows = std::stoi(value());
+        } else if (arg == "--processes") {
+            options.processes = std::stoi(value());
+        } else if (arg == "--stats") {
+            options.print_stats = true;
+        } else if (arg == "--stats-json") {
+            options.stats_json_path = value();
+        } else if (arg == "--region") {
+            options.has_region = true;
+            options.region = parse_region(value());
+        } else if (arg == "--heatmap") {
+            options.heatmap_prefix = value();
+        } else if (arg == "--trace") {
+            options.trace_path = value();
+        } else {
+            throw std::runtime_error("Unknown argument: " + arg);
+        }
+    }
+    return options;
+}
+}
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parse_options(argc, argv);
+        Trace::set_enabled(!options.trace_path.empty());
+        if (Trace::enabled()) {
+            Trace::set_thread_name("main");
+        }
+        const int width = options.width;
+        const int height = options.height;
+
+        Model model(options.model_path);
+
+        Camera camera({0.f, 10.1f, 1.f},
+                      {0.f, -20.f, 0.f},
+                      {0.f, 1.f, 0.f},
+                      45.f,
+                      static_cast<float>(width) / static_cast<float>(height),
+                      0.1f,
+                      20.f);
+        camera.set_reversed_z(options.depth_format == DepthFormat::ReversedFloat32);
+
+        Mat4f model_matrix = Mat4f::translation({0.f, -0.05f, 0.f}) *
+                             Mat4f::scale({1.4f, 1.4f, 1.4f});
+
+        PhongShader shader;
+        shader.set_matrices(model_matrix, camera.view_matrix(), camera.projection_matrix());
+        shader.set_light_direction(normalize(Vec3f{0.4f, 0.8f, 0.1f}));
+        shader.set_light_color({1.f, 0.96f, 0.9f});
+        shader.set_fill_light(normalize(Vec3f{-0.3f, 0.4f, -0.2f}), {0.45f, 0.5f, 0.6f});
+        shader.set_view_position(camera.position());
+        shader.set_material({0.15f, 0.1f, 0.08f},
+                            {0.7f, 0.5f, 0.45f},
+                            {0.4f, 0.35f, 0.3f},
+                            42.f);
+        shader.set_exposure(1.8f);
+
+        if (options.processes > 0) {
+            std::vector<std::string> flags = flags_without_processes(options);
+            if (!flags.empty()) {
+                std::string list;
+                for (const std::string& flag : flags) {
+                    list += (list.empty() ? "" : ", ") + flag;
+                }
+                throw std::runtime_error("--processes cannot be combined with " + list);
+            }
+            MultiProcessConfig mp_config;
+            mp_config.processes = options.processes;
+            mp_config.threads_per_process = std::max(1, options.threads);
+            MultiProcessRenderer renderer(width, height, mp_config);
+            const MultiProcessStats& mp_stats = renderer.render(model, shader);
+            if (!renderer.write_png(options.output_path)) {
+                std::cerr << "Failed to write " << options.output_path << std::endl;
+                return 1;
+            }
+            std::cout << "Rendered image saved to " << options.output_path << std::endl;
+            if (options.print_stats) {
+                std::cout << "Processes: " << mp_stats.tiles_per_process.size() << " in " << mp_stats.total_ms
+                          << " ms\nTiles per process:";
+                for (uint32_t tiles : mp_stats.tiles_per_process) {
+                    std::cout << " " << tiles;
+                }
+                std::cout << "\nFailed processes: " << mp_stats.failed_processes
+                          << ", recovered tiles: " << mp_stats.recovered_tiles << std::endl;
+            }
+            return 0;
+        }
+
+        JobSystemConfig job_config;
+        job_config.worker_count = options.threads;
+        JobSystem jobs(job_config);
+        RenderRegion region = RenderRegion::full_frame(width, height);
+        if (options.has_region) {
+            region = {width, height, options.region[0], options.region[1], options.region[2], options.region[3]};
+        }
+        bool bucketed = options.bucket_rows > 0;
+        if (bucketed) {
+            if (options.has_region || !options.heatmap_prefix.empty()) {
+                throw std::runtime_error("--bucket-rows cannot be combined with --region or --heatmap");
+            }
+            region = {width, height, 0, 0, width, std::min(height, options.bucket_rows)};
+        }
+        Rasterizer raster(region);
+        raster.set_job_system(&jobs);
+        raster.set_framebuffer_layout(options.layout);
+        raster.set_depth_format(options.depth_format);
+        raster.set_sample_count(options.samples);
+        ShadingRateConfig shading_rate;
+        shading_rate.mode = options.shading_rate;
+        raster.set_shading_rate(shading_rate);
+        raster.set_draw_order(options.draw_order);
+        raster.set_depth_prepass(options.depth_prepass);
+        OcclusionCullingConfig occlusion;
+        occlusion.enabled = options.occlusion_culling;
+        raster.set_occlusion_culling(occlusion);
+        raster.set_cluster_culling(options.cluster_culling);
+        if (!options.heatmap_prefix.empty()) {
+            raster.set_debug_mode(DebugMode::DepthComplexity);
+        }
+
+        bool written = false;
+        if (bucketed) {
+            PngStreamWriter png;
+            written = png.open(options.output_path, width, height);
+            if (written) {
+                raster.render_bands(model, shader, png);
+                written = png.finish();
+            }
+        } else {
+            raster.render(model, shader);
+            written = raster.write_png(options.output_path);
+        }
+        if (!written) {
+            std::cerr << "Failed to write " << options.output_path << std::endl;
+            return 1;
+        }
+
+        std::cout << "Rendered image saved to " << options.output_path << std::endl;
+
+        if (!options.heatmap_prefix.empty()) {
+            const DepthComplexity& complexity = raster.depth_complexity();
+            const std::string& prefix = options.heatmap_prefix;
+            if (!complexity.write_heatmap_png(prefix + "_tested.png", ComplexityChannel::Tested) ||
+                !complexity.write_heatmap_png(prefix + "_passed.png", ComplexityChannel::Passed) ||
+                !complexity.write_heatmap_png(prefix + "_shaded.png", ComplexityChannel::Shaded) ||
+                !complexity.write_histogram_csv(prefix + "_histogram.csv")) {
+                throw std::runtime_error("Failed to write heatmaps with prefix: " + prefix);
+            }
+        }
+        if (options.print_stats) {
+            raster.stats().print(std::cout);
+        }
+        if (!options.stats_json_path.empty()) {
+            std::ofstream json(options.stats_json_path);
+            if (!json) {
+                throw std::runtime_error("Failed to open stats file: " + options.stats_json_path);
+            }
+            json << raster.stats().to_json() << "\n";
+        }
+        if (!options.trace_path.empty() && !Trace::write_chrome_json(options.trace_path)) {
+            throw std::runtime_error("Failed to write trace file: " + options.trace_path);
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
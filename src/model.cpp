@@ -1,9 +1,14 @@
 #include "model.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 
+#include "trace.hpp"
+
 namespace {
 std::vector<std::string> tokenize_face(const std::string& token) {
     std::vector<std::string> parts;
@@ -22,6 +27,7 @@ std::vector<std::string> tokenize_face(const std::string& token) {
 }
 
 Model::Model(const std::string& path) {
+    TRACE_SCOPE("Model::load");
     std::ifstream file(path);
     if (!file) {
         throw std::runtime_error("Failed to open OBJ file: " + path);
@@ -43,6 +49,16 @@ Model::Model(const std::string& path) {
             float x, y, z;
             stream >> x >> y >> z;
             normals_.push_back(normalize({x, y, z}));
+        } else if (prefix == "o" || prefix == "g") {
+            std::string name;
+            std::getline(stream >> std::ws, name);
+            if (!objects_.empty() && objects_.back().first_face == faces_.size()) {
+                objects_.back().name = name;
+            } else {
+                ModelObject& object = objects_.emplace_back();
+                object.name = name;
+                object.first_face = faces_.size();
+            }
         } else if (prefix == "f") {
             Face face{};
             for (int i = 0; i < 3; ++i) {
@@ -61,6 +77,217 @@ Model::Model(const std::string& path) {
         }
     }
 
+    for (size_t i = 0; i < objects_.size(); ++i) {
+        size_t end = i + 1 < objects_.size() ? objects_[i + 1].first_face : faces_.size();
+        objects_[i].face_count = end - objects_[i].first_face;
+    }
+    finalize_normals();
+    finalize_objects();
+    build_meshlets();
+}
+
+Model::Model(std::vector<Vec3f> vertices,
+             std::vector<Vec3f> normals,
+             std::vector<Face> faces,
+             std::vector<ModelObject> objects)
+    : vertices_(std::move(vertices)), normals_(std::move(normals)), faces_(std::move(faces)),
+      objects_(std::move(objects)) {
+    size_t next = 0;
+    for (const auto& object : objects_) {
+        if (object.first_face != next || object.face_count > faces_.size() - next) {
+            throw std::invalid_argument("Model objects must cover the faces in order");
+        }
+        next += object.face_count;
+    }
+    if (!objects_.empty() && next != faces_.size()) {
+        throw std::invalid_argument("Model objects must cover the faces in order");
+    }
+    finalize_normals();
+    finalize_objects();
+    build_meshlets();
+}
+
+void Model::finalize_objects() {
+    // Faces before the first group get an unnamed object of their own.
+    size_t first = objects_.empty() ? faces_.size() : objects_.front().first_face;
+    if (first > 0) {
+        ModelObject ungrouped;
+        ungrouped.face_count = first;
+        objects_.insert(objects_.begin(), std::move(ungrouped));
+    }
+    std::erase_if(objects_, [](const ModelObject& object) { return object.face_count == 0; });
+    for (auto& object : objects_) {
+        Vec3f first = vertices_.at(static_cast<size_t>(faces_[object.first_face].vertex_ids[0]));
+        object.bounds = {first, first};
+        for (size_t f = object.first_face; f < object.first_face + object.face_count; ++f) {
+            for (int id : faces_[f].vertex_ids) {
+                object.bounds.extend(vertices_.at(static_cast<size_t>(id)));
+            }
+        }
+        object.sphere = {object.bounds.center(), 0.f};
+        for (size_t f = object.first_face; f < object.first_face + object.face_count; ++f) {
+            for (int id : faces_[f].vertex_ids) {
+                object.sphere.radius = std::max(object.sphere.radius,
+                                                length(vertices_[static_cast<size_t>(id)] - object.sphere.center));
+            }
+        }
+    }
+    if (!vertices_.empty()) {
+        bounds_ = {vertices_.front(), vertices_.front()};
+        for (const Vec3f& v : vertices_) {
+            bounds_.extend(v);
+        }
+        sphere_ = {bounds_.center(), 0.f};
+        for (const Vec3f& v : vertices_) {
+            sphere_.radius = std::max(sphere_.radius, length(v - sphere_.center));
+        }
+    }
+
+    // Sorting the object's edges by their vertex pair puts shared edges next
+    // to each other.
+    open_edges_.assign(faces_.size(), 0);
+    std::vector<std::pair<uint64_t, size_t>> edges;
+    for (const auto& object : objects_) {
+        edges.clear();
+        for (size_t f = object.first_face; f < object.first_face + object.face_count; ++f) {
+            const auto& ids = faces_[f].vertex_ids;
+            for (int i = 0; i < 3; ++i) {
+                auto a = static_cast<uint32_t>(ids[i]);
+                auto b = static_cast<uint32_t>(ids[(i + 1) % 3]);
+                uint64_t key = (uint64_t{std::min(a, b)} << 32) | std::max(a, b);
+                edges.emplace_back(key, f * 3 + static_cast<size_t>(i));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size(); ++i) {
+            bool shared = (i > 0 && edges[i - 1].first == edges[i].first) ||
+                          (i + 1 < edges.size() && edges[i + 1].first == edges[i].first);
+            if (!shared) {
+                open_edges_[edges[i].second / 3] |= static_cast<uint8_t>(1u << (edges[i].second % 3));
+            }
+        }
+    }
+}
+
+// Each meshlet grows breadth-first from the first unassigned face of its
+// object across shared vertices, so it stays compact and its normal cone
+// tight even when the file lists faces in no spatial order. A face that would
+// exceed the vertex limit is left for a later meshlet.
+void Model::build_meshlets() {
+    meshlets_.clear();
+    meshlet_faces_.clear();
+    meshlet_faces_.reserve(faces_.size());
+
+    // Faces around each vertex, in compressed rows.
+    std::vector<uint32_t> vertex_face_start(vertices_.size() + 1, 0);
+    for (const auto& face : faces_) {
+        for (int v : face.vertex_ids) {
+            ++vertex_face_start[static_cast<size_t>(v) + 1];
+        }
+    }
+    for (size_t v = 0; v < vertices_.size(); ++v) {
+        vertex_face_start[v + 1] += vertex_face_start[v];
+    }
+    std::vector<uint32_t> vertex_faces(vertex_face_start.back());
+    std::vector<uint32_t> fill(vertex_face_start.begin(), vertex_face_start.end() - 1);
+    for (size_t f = 0; f < faces_.size(); ++f) {
+        for (int v : faces_[f].vertex_ids) {
+            vertex_faces[fill[static_cast<size_t>(v)]++] = static_cast<uint32_t>(f);
+        }
+    }
+
+    auto face_normal = [&](size_t f) {
+        const auto& ids = faces_[f].vertex_ids;
+        Vec3f v0 = vertices_[static_cast<size_t>(ids[0])];
+        return normalize(cross(vertices_[static_cast<size_t>(ids[1])] - v0,
+                               vertices_[static_cast<size_t>(ids[2])] - v0));
+    };
+
+    std::vector<uint8_t> assigned(faces_.size(), 0);
+    std::vector<size_t> queued(faces_.size(), SIZE_MAX);
+    std::vector<size_t> stamp(vertices_.size(), SIZE_MAX);
+    std::vector<int> members;
+    std::vector<uint32_t> queue;
+    for (auto& object : objects_) {
+        object.first_meshlet = meshlets_.size();
+        size_t end = object.first_face + object.face_count;
+        for (size_t seed = object.first_face; seed < end; ++seed) {
+            if (assigned[seed]) {
+                continue;
+            }
+            size_t id = meshlets_.size();
+            Meshlet meshlet;
+            meshlet.face_offset = meshlet_faces_.size();
+            members.clear();
+            queue.assign(1, static_cast<uint32_t>(seed));
+            queued[seed] = id;
+            for (size_t next = 0; next < queue.size() && meshlet.face_count < Meshlet::kMaxFaces; ++next) {
+                uint32_t f = queue[next];
+                const auto& ids = faces_[f].vertex_ids;
+                size_t added = 0;
+                for (int v : ids) {
+                    added += stamp[static_cast<size_t>(v)] != id ? 1 : 0;
+                }
+                if (members.size() + added > Meshlet::kMaxVertices) {
+                    continue;
+                }
+                assigned[f] = 1;
+                meshlet_faces_.push_back(f);
+                ++meshlet.face_count;
+                for (int v : ids) {
+                    auto vertex = static_cast<size_t>(v);
+                    if (stamp[vertex] != id) {
+                        stamp[vertex] = id;
+                        members.push_back(v);
+                    }
+                    for (uint32_t k = vertex_face_start[vertex]; k < vertex_face_start[vertex + 1]; ++k) {
+                        uint32_t neighbour = vertex_faces[k];
+                        if (!assigned[neighbour] && queued[neighbour] != id && neighbour >= object.first_face &&
+                            neighbour < end) {
+                            queued[neighbour] = id;
+                            queue.push_back(neighbour);
+                        }
+                    }
+                }
+            }
+
+            Aabb box{vertices_[static_cast<size_t>(members[0])], vertices_[static_cast<size_t>(members[0])]};
+            for (int v : members) {
+                box.extend(vertices_[static_cast<size_t>(v)]);
+            }
+            meshlet.sphere = {box.center(), 0.f};
+            for (int v : members) {
+                meshlet.sphere.radius =
+                    std::max(meshlet.sphere.radius, length(vertices_[static_cast<size_t>(v)] - meshlet.sphere.center));
+            }
+
+            // Degenerate faces never produce fragments and do not constrain
+            // the cone.
+            const uint32_t* faces = meshlet_faces_.data() + meshlet.face_offset;
+            Vec3f axis{};
+            for (size_t k = 0; k < meshlet.face_count; ++k) {
+                axis += face_normal(faces[k]);
+            }
+            if (length(axis) > 0.f) {
+                meshlet.cone_axis = normalize(axis);
+                float min_dot = 1.f;
+                for (size_t k = 0; k < meshlet.face_count; ++k) {
+                    Vec3f n = face_normal(faces[k]);
+                    min_dot = length(n) > 0.f ? std::min(min_dot, dot(n, meshlet.cone_axis)) : min_dot;
+                }
+                // Normals spreading past 90 degrees leave no view direction
+                // from which every face is back-facing.
+                if (min_dot > 0.f) {
+                    meshlet.cone_cutoff = std::sqrt(std::max(0.f, 1.f - min_dot * min_dot));
+                }
+            }
+            meshlets_.push_back(meshlet);
+        }
+        object.meshlet_count = meshlets_.size() - object.first_meshlet;
+    }
+}
+
+void Model::finalize_normals() {
     if (normals_.empty()) {
         normals_.resize(vertices_.size(), Vec3f{});
         std::vector<int> counts(vertices_.size(), 0);
@@ -0,0 +1,250 @@
+#include "multiprocess_renderer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SR_HAS_POSIX_SHM 1
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "job_system.hpp"
+#include "rasterizer.hpp"
+#include "render_region.hpp"
+#include "render_stats.hpp"
+
+struct MultiProcessRenderer::SharedHeader {
+    std::atomic<uint32_t> next_tile{0};
+};
+
+namespace {
+enum TileState : uint8_t { kTilePending = 0, kTileClaimed = 1, kTileDone = 2 };
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Dynamic tile queue shared by every process through the mapped header.
+class SharedTileSource : public ITileSource {
+public:
+    SharedTileSource(std::atomic<uint32_t>& next,
+                     std::atomic<uint8_t>* states,
+                     uint32_t count,
+                     std::atomic<uint32_t>& rendered)
+        : next_(next), states_(states), count_(count), rendered_(rendered) {}
+
+    bool claim(int& tile) override {
+        uint32_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= count_) {
+            return false;
+        }
+        states_[index].store(kTileClaimed, std::memory_order_relaxed);
+        tile = static_cast<int>(index);
+        return true;
+    }
+
+    void complete(int tile) override {
+        states_[tile].store(kTileDone, std::memory_order_release);
+        rendered_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t>& next_;
+    std::atomic<uint8_t>* states_;
+    uint32_t count_;
+    std::atomic<uint32_t>& rendered_;
+};
+
+class ListTileSource : public ITileSource {
+public:
+    ListTileSource(std::vector<int> tiles, std::atomic<uint8_t>* states)
+        : tiles_(std::move(tiles)), states_(states) {}
+
+    bool claim(int& tile) override {
+        size_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        if (index >= tiles_.size()) {
+            return false;
+        }
+        tile = tiles_[index];
+        return true;
+    }
+
+    void complete(int tile) override { states_[tile].store(kTileDone, std::memory_order_release); }
+
+private:
+    std::vector<int> tiles_;
+    std::atomic<uint8_t>* states_;
+    std::atomic<size_t> next_{0};
+};
+}
+
+MultiProcessRenderer::MultiProcessRenderer(int width, int height, MultiProcessConfig config)
+    : width_(width), height_(height), config_(config), image_(0, 0) {
+#ifdef SR_HAS_POSIX_SHM
+    RenderRegion frame = RenderRegion::full_frame(width, height);
+    if (width <= 0 || height <= 0) {
+        throw std::invalid_argument("Frame size must be positive");
+    }
+    config_.threads_per_process = std::max(1, config_.threads_per_process);
+    if (config_.processes <= 0) {
+        int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        config_.processes = std::max(1, cores / config_.threads_per_process);
+    }
+    tile_count_ = Rasterizer::tile_count(frame);
+
+    size_t pixels = static_cast<size_t>(width) * height;
+    size_t states_offset = align_up(sizeof(SharedHeader), 64);
+    size_t counters_offset = align_up(states_offset + static_cast<size_t>(tile_count_), 64);
+    size_t color_offset = align_up(counters_offset + sizeof(std::atomic<uint32_t>) * config_.processes, 64);
+    size_t depth_offset = align_up(color_offset + pixels * 3, 64);
+    mapping_size_ = depth_offset + pixels * sizeof(float);
+
+    static std::atomic<int> sequence{0};
+    std::string name = "/software_renderer_" + std::to_string(getpid()) + "_" + std::to_string(sequence++);
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("shm_open failed: " + std::string(std::strerror(errno)));
+    }
+    // Forked workers inherit the mapping, so the name is not needed past this point.
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, static_cast<off_t>(mapping_size_)) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Failed to size shared frame buffer: " + std::string(std::strerror(error)));
+    }
+    mapping_ = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping_ == MAP_FAILED) {
+        mapping_ = nullptr;
+        throw std::runtime_error("Failed to map shared frame buffer: " + std::string(std::strerror(errno)));
+    }
+
+    auto* base = static_cast<uint8_t*>(mapping_);
+    header_ = new (base) SharedHeader();
+    tile_states_ = reinterpret_cast<std::atomic<uint8_t>*>(base + states_offset);
+    for (int i = 0; i < tile_count_; ++i) {
+        new (tile_states_ + i) std::atomic<uint8_t>(kTilePending);
+    }
+    process_tiles_ = reinterpret_cast<std::atomic<uint32_t>*>(base + counters_offset);
+    for (int i = 0; i < config_.processes; ++i) {
+        new (process_tiles_ + i) std::atomic<uint32_t>(0);
+    }
+    color_ = base + color_offset;
+    depth_ = reinterpret_cast<float*>(base + depth_offset);
+    image_ = Image::view(width, height, color_);
+#else
+    throw std::runtime_error("Multi-process rendering needs POSIX shared memory");
+#endif
+}
+
+MultiProcessRenderer::~MultiProcessRenderer() {
+#ifdef SR_HAS_POSIX_SHM
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+    }
+#endif
+}
+
+MultiProcessStats MultiProcessRenderer::render(const Model& model, IShader& shader) {
+    auto start = StatsClock::now();
+    stats_ = MultiProcessStats{};
+#ifdef SR_HAS_POSIX_SHM
+    header_->next_tile.store(0);
+    for (int i = 0; i < tile_count_; ++i) {
+        tile_states_[i].store(kTilePending);
+    }
+    for (int i = 0; i < config_.processes; ++i) {
+        process_tiles_[i].store(0);
+    }
+
+    std::vector<pid_t> children;
+    children.reserve(static_cast<size_t>(config_.processes));
+    for (int process = 0; process < config_.processes; ++process) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int code = 0;
+            try {
+                render_worker(process, model, shader);
+            } catch (...) {
+                code = 1;
+            }
+            _exit(code);
+        }
+        if (pid < 0) {
+            ++stats_.failed_processes;
+            continue;
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++stats_.failed_processes;
+        }
+    }
+
+    recover_tiles(model, shader);
+    for (int i = 0; i < config_.processes; ++i) {
+        stats_.tiles_per_process.push_back(process_tiles_[i].load());
+    }
+#else
+    (void)model;
+    (void)shader;
+#endif
+    stats_.total_ms = elapsed_ms(start, StatsClock::now());
+    return stats_;
+}
+
+void MultiProcessRenderer::render_worker(int process, const Model& model, IShader& shader) {
+#ifdef __linux__
+    if (config_.pin_processes) {
+        int cpu_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int i = 0; i < config_.threads_per_process; ++i) {
+            CPU_SET((process * config_.threads_per_process + i) % cpu_count, &set);
+        }
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+    JobSystemConfig job_config;
+    job_config.worker_count = config_.threads_per_process;
+    JobSystem jobs(job_config);
+    Rasterizer raster(RenderRegion::full_frame(width_, height_), color_, depth_);
+    raster.set_job_system(&jobs);
+    SharedTileSource source(header_->next_tile, tile_states_, static_cast<uint32_t>(tile_count_),
+                            process_tiles_[process]);
+    raster.set_tile_source(&source);
+    raster.render(model, shader);
+}
+
+void MultiProcessRenderer::recover_tiles(const Model& model, IShader& shader) {
+    std::vector<int> missing;
+    for (int i = 0; i < tile_count_; ++i) {
+        if (tile_states_[i].load(std::memory_order_acquire) != kTileDone) {
+            missing.push_back(i);
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+    stats_.recovered_tiles = static_cast<uint32_t>(missing.size());
+    JobSystemConfig job_config;
+    job_config.worker_count = config_.threads_per_process;
+    JobSystem jobs(job_config);
+    Rasterizer raster(RenderRegion::full_frame(width_, height_), color_, depth_);
+    raster.set_job_system(&jobs);
+    ListTileSource source(std::move(missing), tile_states_);
+    raster.set_tile_source(&source);
+    raster.render(model, shader);
+}
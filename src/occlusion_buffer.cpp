@@ -0,0 +1,219 @@
+#include "occlusion_buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr float kMinW = 1e-5f;
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+}
+
+OcclusionBuffer::OcclusionBuffer(int width, int height, int scale) {
+    resize(width, height, scale);
+}
+
+void OcclusionBuffer::resize(int width, int height, int scale) {
+    if (width <= 0 || height <= 0 || scale <= 0) {
+        throw std::invalid_argument("Occlusion buffer size and scale must be positive");
+    }
+    width_ = width;
+    height_ = height;
+    scale_ = scale;
+    buffer_width_ = (width + scale - 1) / scale;
+    buffer_height_ = (height + scale - 1) / scale;
+    tiles_x_ = (buffer_width_ + kTileSize - 1) / kTileSize;
+    tiles_y_ = (buffer_height_ + kTileSize - 1) / kTileSize;
+    tiles_.resize(static_cast<size_t>(tiles_x_) * tiles_y_);
+    outside_.assign(tiles_.size(), 0);
+    for (int ty = 0; ty < tiles_y_; ++ty) {
+        for (int tx = 0; tx < tiles_x_; ++tx) {
+            uint64_t outside = 0;
+            for (int bit = 0; bit < kTileSize * kTileSize; ++bit) {
+                int x = tx * kTileSize + bit % kTileSize;
+                int y = ty * kTileSize + bit / kTileSize;
+                if (x >= buffer_width_ || y >= buffer_height_) {
+                    outside |= uint64_t{1} << bit;
+                }
+            }
+            outside_[static_cast<size_t>(ty) * tiles_x_ + tx] = outside;
+        }
+    }
+    clear();
+}
+
+void OcclusionBuffer::clear() {
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+        tiles_[i] = {outside_[i], kInfinity, -kInfinity};
+    }
+}
+
+// Same viewport mapping as Rasterizer::transform_vertices.
+Vec3f OcclusionBuffer::to_screen(const Vec4f& clip) const {
+    float inv_w = 1.f / clip.w;
+    return {(clip.x * inv_w + 1.f) * 0.5f * static_cast<float>(width_ - 1),
+            (1.f - (clip.y * inv_w + 1.f) * 0.5f) * static_cast<float>(height_ - 1),
+            reversed_z_ ? 1.f - clip.z * inv_w : (clip.z * inv_w + 1.f) * 0.5f};
+}
+
+void OcclusionBuffer::merge(Tile& tile, size_t index, uint64_t mask, float depth) {
+    if (depth >= tile.z0) {
+        return;
+    }
+    tile.mask |= mask;
+    tile.z1 = std::max(tile.z1, depth);
+    if (tile.mask == ~uint64_t{0}) {
+        tile.z0 = tile.z1;
+        tile.mask = outside_[index];
+        tile.z1 = -kInfinity;
+    }
+}
+
+void OcclusionBuffer::render_occluder(const Vec4f& a, const Vec4f& b, const Vec4f& c, uint8_t open_edges) {
+    if (!(a.w > kMinW && b.w > kMinW && c.w > kMinW)) {
+        return;
+    }
+    Vec3f p[3] = {to_screen(a), to_screen(b), to_screen(c)};
+    float det = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if (!(std::abs(det) > 1e-8f)) {
+        return;
+    }
+    // E_i(p[i + 2]) = -det, so flip the edges to be positive inside.
+    float orientation = det > 0.f ? -1.f : 1.f;
+    float ddx = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / det;
+    float ddy = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / det;
+    float max_depth = std::max({p[0].z, p[1].z, p[2].z});
+
+    // Edge i runs from p[i] to p[i + 1] and is positive inside. Past an open
+    // edge a buffer pixel's whole square of frame pixels must be inside, i.e.
+    // E at its center must reach the edge's extent over half a square. A
+    // shared edge only tests the center; the neighbour on the other side sees
+    // the negated edge, so the tie goes to exactly one of the two.
+    float edge_a[3];
+    float edge_b[3];
+    float edge_c[3];
+    float threshold[3];
+    bool inclusive[3];
+    float half = 0.5f * static_cast<float>(scale_);
+    for (int i = 0; i < 3; ++i) {
+        const Vec3f& from = p[i];
+        const Vec3f& to = p[(i + 1) % 3];
+        edge_a[i] = orientation * (to.y - from.y);
+        edge_b[i] = orientation * (from.x - to.x);
+        edge_c[i] = -(edge_a[i] * from.x + edge_b[i] * from.y);
+        bool open = (open_edges >> i) & 1;
+        threshold[i] = open ? (std::abs(edge_a[i]) + std::abs(edge_b[i])) * half : 0.f;
+        inclusive[i] = open || edge_a[i] > 0.f || (edge_a[i] == 0.f && edge_b[i] > 0.f);
+    }
+    float scale = static_cast<float>(scale_);
+
+    float inv_scale = 1.f / static_cast<float>(scale_);
+    float min_x = std::min({p[0].x, p[1].x, p[2].x}) * inv_scale;
+    float max_x = std::max({p[0].x, p[1].x, p[2].x}) * inv_scale;
+    float min_y = std::min({p[0].y, p[1].y, p[2].y}) * inv_scale;
+    float max_y = std::max({p[0].y, p[1].y, p[2].y}) * inv_scale;
+    if (max_x < 0.f || max_y < 0.f || min_x >= static_cast<float>(buffer_width_) ||
+        min_y >= static_cast<float>(buffer_height_)) {
+        return;
+    }
+    int tx0 = static_cast<int>(std::max(0.f, min_x)) / kTileSize;
+    int ty0 = static_cast<int>(std::max(0.f, min_y)) / kTileSize;
+    int tx1 = static_cast<int>(std::min(max_x, static_cast<float>(buffer_width_ - 1))) / kTileSize;
+    int ty1 = static_cast<int>(std::min(max_y, static_cast<float>(buffer_height_ - 1))) / kTileSize;
+    float tile_extent = static_cast<float>(kTileSize * scale_);
+
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            uint64_t mask = 0;
+            float cx0 = (static_cast<float>(tx * kTileSize) + 0.5f) * scale;
+            for (int row = 0; row < kTileSize; ++row) {
+                float cy = (static_cast<float>(ty * kTileSize + row) + 0.5f) * scale;
+                uint64_t row_mask = 0xff;
+                for (int i = 0; i < 3; ++i) {
+                    uint64_t edge_mask = 0;
+                    for (int column = 0; column < kTileSize; ++column) {
+                        float cx = cx0 + static_cast<float>(column) * scale;
+                        float e = edge_a[i] * cx + edge_b[i] * cy + edge_c[i];
+                        bool inside = e > threshold[i] || (e == threshold[i] && inclusive[i]);
+                        edge_mask |= static_cast<uint64_t>(inside) << column;
+                    }
+                    row_mask &= edge_mask;
+                }
+                mask |= row_mask << (row * kTileSize);
+            }
+            size_t index = static_cast<size_t>(ty) * tiles_x_ + tx;
+            mask &= ~outside_[index];
+            if (!mask) {
+                continue;
+            }
+            // The depth plane is exact in screen space, so its largest value
+            // at the tile corners bounds the triangle within the tile.
+            float x0 = static_cast<float>(tx) * tile_extent - p[0].x;
+            float y0 = static_cast<float>(ty) * tile_extent - p[0].y;
+            float corner_x = std::max(ddx * x0, ddx * (x0 + tile_extent));
+            float corner_y = std::max(ddy * y0, ddy * (y0 + tile_extent));
+            float depth = std::min(max_depth, p[0].z + corner_x + corner_y);
+            merge(tiles_[index], index, mask, depth);
+        }
+    }
+}
+
+bool OcclusionBuffer::project(const Mat4f& clip_transform,
+                              const Aabb& box,
+                              ScreenBounds& bounds) const {
+    bounds = {kInfinity, kInfinity, -kInfinity, -kInfinity, kInfinity};
+    for (int corner = 0; corner < 8; ++corner) {
+        Vec3f point{corner & 1 ? box.max.x : box.min.x,
+                    corner & 2 ? box.max.y : box.min.y,
+                    corner & 4 ? box.max.z : box.min.z};
+        Vec4f clip = clip_transform * to_vec4(point, 1.f);
+        if (!(clip.w > kMinW)) {
+            return false;
+        }
+        Vec3f screen = to_screen(clip);
+        bounds.x0 = std::min(bounds.x0, screen.x);
+        bounds.y0 = std::min(bounds.y0, screen.y);
+        bounds.x1 = std::max(bounds.x1, screen.x);
+        bounds.y1 = std::max(bounds.y1, screen.y);
+        bounds.nearest_depth = std::min(bounds.nearest_depth, screen.z);
+    }
+    return true;
+}
+
+bool OcclusionBuffer::visible(const ScreenBounds& bounds) const {
+    float inv_scale = 1.f / static_cast<float>(scale_);
+    // Frame pixel x samples at x + 0.5, so this is every buffer pixel holding
+    // a frame pixel the box reaches.
+    float x0 = std::floor(bounds.x0 - 0.5f) * inv_scale;
+    float y0 = std::floor(bounds.y0 - 0.5f) * inv_scale;
+    float x1 = std::ceil(bounds.x1 - 0.5f) * inv_scale;
+    float y1 = std::ceil(bounds.y1 - 0.5f) * inv_scale;
+    if (!(x1 >= 0.f && y1 >= 0.f && x0 < static_cast<float>(buffer_width_) &&
+          y0 < static_cast<float>(buffer_height_))) {
+        // Off screen; frustum culling is not this buffer's job.
+        return true;
+    }
+    int px0 = static_cast<int>(std::max(0.f, x0));
+    int py0 = static_cast<int>(std::max(0.f, y0));
+    int px1 = static_cast<int>(std::min(x1, static_cast<float>(buffer_width_ - 1)));
+    int py1 = static_cast<int>(std::min(y1, static_cast<float>(buffer_height_ - 1)));
+    for (int ty = py0 / kTileSize; ty <= py1 / kTileSize; ++ty) {
+        for (int tx = px0 / kTileSize; tx <= px1 / kTileSize; ++tx) {
+            const Tile& tile = tiles_[static_cast<size_t>(ty) * tiles_x_ + tx];
+            if (bounds.nearest_depth >= tile.z0) {
+                continue;
+            }
+            uint64_t rect = 0;
+            for (int y = std::max(py0, ty * kTileSize); y <= std::min(py1, ty * kTileSize + kTileSize - 1); ++y) {
+                for (int x = std::max(px0, tx * kTileSize); x <= std::min(px1, tx * kTileSize + kTileSize - 1); ++x) {
+                    rect |= uint64_t{1} << ((y - ty * kTileSize) * kTileSize + (x - tx * kTileSize));
+                }
+            }
+            if ((rect & ~tile.mask) || bounds.nearest_depth < tile.z1) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,327 @@
+#include "png_stream.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include "trace.hpp"
+
+namespace {
+constexpr uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+constexpr int kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr int kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                  2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int kDistanceBase[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,    65,    97,    129,
+                                   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr int kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr int kMinMatch = 3;
+constexpr int kMaxMatch = 258;
+constexpr int kMaxChain = 16;
+
+struct CrcTable {
+    uint32_t values[256];
+
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            values[n] = c;
+        }
+    }
+};
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    static const CrcTable table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void put_u32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+// Huffman codes are sent most significant bit first.
+uint32_t reverse_bits(uint32_t code, int length) {
+    uint32_t result = 0;
+    for (int i = 0; i < length; ++i) {
+        result = (result << 1) | ((code >> i) & 1);
+    }
+    return result;
+}
+
+uint32_t hash3(const uint8_t* p) {
+    return ((static_cast<uint32_t>(p[0]) << 16 | static_cast<uint32_t>(p[1]) << 8 | p[2]) * 2654435761u) >> 17;
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+}
+
+PngStreamWriter::~PngStreamWriter() = default;
+
+bool PngStreamWriter::open(const std::string& path, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        return false;
+    }
+    width_ = width;
+    height_ = height;
+    rows_written_ = 0;
+    failed_ = false;
+    size_t stride = static_cast<size_t>(width) * 3;
+    previous_row_.assign(stride, 0);
+    for (auto& candidate : candidates_) {
+        candidate.resize(stride + 1);
+    }
+    head_.assign(kHashSize, -1);
+    chain_.assign(kWindowSize, -1);
+    bit_buffer_ = 0;
+    bit_count_ = 0;
+    adler_a_ = 1;
+    adler_b_ = 0;
+
+    uint8_t header[13];
+    put_u32(header, static_cast<uint32_t>(width));
+    put_u32(header + 4, static_cast<uint32_t>(height));
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    out_.write(reinterpret_cast<const char*>(kSignature), sizeof(kSignature));
+    if (!write_chunk("IHDR", header, sizeof(header))) {
+        return false;
+    }
+    // zlib header: deflate with a 32K window, no preset dictionary.
+    compressed_.clear();
+    compressed_.push_back(0x78);
+    compressed_.push_back(0x01);
+    return true;
+}
+
+bool PngStreamWriter::write_rows(const uint8_t* rows, int count) {
+    TRACE_SCOPE("PngStreamWriter::write_rows");
+    if (failed_ || !out_.is_open() || count <= 0 || rows_written_ + count > height_) {
+        return false;
+    }
+    size_t stride = static_cast<size_t>(width_) * 3;
+    filtered_.clear();
+    for (int y = 0; y < count; ++y) {
+        filter_row(rows + static_cast<size_t>(y) * stride);
+    }
+    rows_written_ += count;
+
+    // 5552 bytes is the longest run before the Adler sums can overflow.
+    for (size_t begin = 0; begin < filtered_.size(); begin += 5552) {
+        size_t end = std::min(filtered_.size(), begin + 5552);
+        for (size_t i = begin; i < end; ++i) {
+            adler_a_ += filtered_[i];
+            adler_b_ += adler_a_;
+        }
+        adler_a_ %= 65521u;
+        adler_b_ %= 65521u;
+    }
+    deflate_block(filtered_.data(), filtered_.size(), false);
+    if (!compressed_.empty() && !write_chunk("IDAT", compressed_.data(), compressed_.size())) {
+        return false;
+    }
+    compressed_.clear();
+    return true;
+}
+
+bool PngStreamWriter::finish() {
+    if (failed_ || !out_.is_open() || rows_written_ != height_) {
+        return false;
+    }
+    deflate_block(nullptr, 0, true);
+    flush_bits();
+    uint8_t adler[4];
+    put_u32(adler, adler_b_ << 16 | adler_a_);
+    compressed_.insert(compressed_.end(), adler, adler + 4);
+    bool ok = write_chunk("IDAT", compressed_.data(), compressed_.size()) && write_chunk("IEND", nullptr, 0);
+    compressed_.clear();
+    out_.close();
+    return ok && !out_.fail();
+}
+
+void PngStreamWriter::filter_row(const uint8_t* row) {
+    // Same heuristic as most encoders: pick the filter with the smallest sum
+    // of absolute signed residuals.
+    size_t stride = static_cast<size_t>(width_) * 3;
+    const uint8_t* up = previous_row_.data();
+    int best = 0;
+    uint64_t best_score = UINT64_MAX;
+    for (int filter = 0; filter < 5; ++filter) {
+        uint8_t* out = candidates_[static_cast<size_t>(filter)].data();
+        out[0] = static_cast<uint8_t>(filter);
+        uint64_t score = 0;
+        for (size_t i = 0; i < stride; ++i) {
+            int left = i >= 3 ? row[i - 3] : 0;
+            int upper_left = i >= 3 ? up[i - 3] : 0;
+            int predicted = 0;
+            switch (filter) {
+                case 1: predicted = left; break;
+                case 2: predicted = up[i]; break;
+                case 3: predicted = (left + up[i]) >> 1; break;
+                case 4: predicted = paeth(left, up[i], upper_left); break;
+                default: break;
+            }
+            auto value = static_cast<uint8_t>(row[i] - predicted);
+            out[i + 1] = value;
+            score += static_cast<uint64_t>(std::abs(static_cast<int8_t>(value)));
+        }
+        if (score < best_score) {
+            best_score = score;
+            best = filter;
+        }
+    }
+    const auto& chosen = candidates_[static_cast<size_t>(best)];
+    filtered_.insert(filtered_.end(), chosen.begin(), chosen.end());
+    std::copy(row, row + stride, previous_row_.begin());
+}
+
+void PngStreamWriter::deflate_block(const uint8_t* data, size_t size, bool final_block) {
+    // One fixed-Huffman block per batch. Matches stay inside the batch, so
+    // the hash tables are only reset, never carried over.
+    put_bits(final_block ? 1u : 0u, 1);
+    put_bits(1, 2);
+    std::fill(head_.begin(), head_.end(), -1);
+    size_t pos = 0;
+    while (pos < size) {
+        int best_length = 0;
+        int best_distance = 0;
+        if (pos + kMinMatch <= size) {
+            uint32_t hash = hash3(data + pos);
+            int max_length = static_cast<int>(std::min<size_t>(kMaxMatch, size - pos));
+            int32_t candidate = head_[hash];
+            for (int steps = 0; candidate >= 0 && steps < kMaxChain; ++steps) {
+                size_t distance = pos - static_cast<size_t>(candidate);
+                if (distance > kWindowSize) {
+                    break;
+                }
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + pos;
+                int length = 0;
+                while (length < max_length && a[length] == b[length]) {
+                    ++length;
+                }
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = static_cast<int>(distance);
+                    if (length == max_length) {
+                        break;
+                    }
+                }
+                candidate = chain_[static_cast<size_t>(candidate) % kWindowSize];
+            }
+        }
+
+        size_t advance = best_length >= kMinMatch ? static_cast<size_t>(best_length) : 1;
+        if (best_length >= kMinMatch) {
+            put_match(best_length, best_distance);
+        } else {
+            put_literal(data[pos]);
+        }
+        for (size_t end = pos + advance; pos < end; ++pos) {
+            if (pos + kMinMatch <= size) {
+                uint32_t hash = hash3(data + pos);
+                chain_[pos % kWindowSize] = head_[hash];
+                head_[hash] = static_cast<int32_t>(pos);
+            }
+        }
+    }
+    put_literal(256);
+    while (bit_count_ >= 8) {
+        compressed_.push_back(static_cast<uint8_t>(bit_buffer_));
+        bit_buffer_ >>= 8;
+        bit_count_ -= 8;
+    }
+}
+
+void PngStreamWriter::put_bits(uint32_t bits, int count) {
+    bit_buffer_ |= static_cast<uint64_t>(bits) << bit_count_;
+    bit_count_ += count;
+    if (bit_count_ >= 32) {
+        while (bit_count_ >= 8) {
+            compressed_.push_back(static_cast<uint8_t>(bit_buffer_));
+            bit_buffer_ >>= 8;
+            bit_count_ -= 8;
+        }
+    }
+}
+
+void PngStreamWriter::put_literal(int symbol) {
+    if (symbol < 144) {
+        put_bits(reverse_bits(0x30 + symbol, 8), 8);
+    } else if (symbol < 256) {
+        put_bits(reverse_bits(0x190 + symbol - 144, 9), 9);
+    } else if (symbol < 280) {
+        put_bits(reverse_bits(symbol - 256, 7), 7);
+    } else {
+        put_bits(reverse_bits(0xc0 + symbol - 280, 8), 8);
+    }
+}
+
+void PngStreamWriter::put_match(int length, int distance) {
+    int code = 28;
+    while (kLengthBase[code] > length) {
+        --code;
+    }
+    put_literal(257 + code);
+    put_bits(static_cast<uint32_t>(length - kLengthBase[code]), kLengthExtra[code]);
+    int distance_code = 29;
+    while (kDistanceBase[distance_code] > distance) {
+        --distance_code;
+    }
+    put_bits(reverse_bits(static_cast<uint32_t>(distance_code), 5), 5);
+    put_bits(static_cast<uint32_t>(distance - kDistanceBase[distance_code]), kDistanceExtra[distance_code]);
+}
+
+void PngStreamWriter::flush_bits() {
+    while (bit_count_ > 0) {
+        compressed_.push_back(static_cast<uint8_t>(bit_buffer_));
+        bit_buffer_ >>= 8;
+        bit_count_ = std::max(0, bit_count_ - 8);
+    }
+}
+
+bool PngStreamWriter::write_chunk(const char* type, const uint8_t* data, size_t size) {
+    uint8_t header[8];
+    put_u32(header, static_cast<uint32_t>(size));
+    std::copy(type, type + 4, header + 4);
+    uint32_t crc = crc32(0, header + 4, 4);
+    if (size > 0) {
+        crc = crc32(crc, data, size);
+    }
+    uint8_t footer[4];
+    put_u32(footer, crc);
+    out_.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (size > 0) {
+        out_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+    out_.write(reinterpret_cast<const char*>(footer), sizeof(footer));
+    failed_ = failed_ || !out_;
+    return !failed_;
+}
@@ -1,13 +1,463 @@
 #include "rasterizer.hpp"
 
 #include <algorithm>
+#include <bit>
 #include <cmath>
+#include <cstring>
 #include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "simd.hpp"
+#include "trace.hpp"
+
+namespace {
+uint64_t elapsed_ns(StatsClock::time_point start, StatsClock::time_point end) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+// Object-space point that clip maps to x = y = w = 0, i.e. the eye; none
+// for a parallel projection.
+std::optional<Vec3f> clip_eye(const Mat4f& clip) {
+    const auto& a = clip[0];
+    const auto& b = clip[1];
+    const auto& c = clip[3];
+    auto minor = [&](int i, int j, int k) {
+        return a[i] * (b[j] * c[k] - b[k] * c[j]) - a[j] * (b[i] * c[k] - b[k] * c[i]) +
+               a[k] * (b[i] * c[j] - b[j] * c[i]);
+    };
+    float x = minor(1, 2, 3);
+    float y = -minor(0, 2, 3);
+    float z = minor(0, 1, 3);
+    float w = -minor(0, 1, 2);
+    if (std::abs(w) < 1e-12f) {
+        return std::nullopt;
+    }
+    return Vec3f{x / w, y / w, z / w};
+}
+
+// Index of the last of count items whose field is at most offset; items
+// are sorted by field and the first one's is zero.
+template <typename T>
+size_t containing_range(const T* items, size_t count, size_t T::*field, size_t offset) {
+    const T* next = std::upper_bound(items, items + count, offset,
+                                     [&](size_t value, const T& item) { return value < item.*field; });
+    return static_cast<size_t>(next - items) - 1;
+}
+
+// out[i] gets the clip and world positions of positions[i] and 1 / clip w,
+// four vertices per Float4, rounded exactly like PhongShader::vertex.
+template <typename Vertex>
+void transform_positions(const Mat4f& clip, const Mat4f& world, const Vec3f* positions, size_t count, Vertex* out) {
+    for (size_t i = 0; i < count; i += 4) {
+        size_t lanes = std::min<size_t>(4, count - i);
+        std::array<float, 4> x{};
+        std::array<float, 4> y{};
+        std::array<float, 4> z{};
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            x[lane] = positions[i + lane].x;
+            y[lane] = positions[i + lane].y;
+            z[lane] = positions[i + lane].z;
+        }
+        Vec3f4 p{Float4::load(x), Float4::load(y), Float4::load(z)};
+        // m * (p, 1); m[row][3] * 1 is exact.
+        auto row = [&](const Mat4f& m, int r) {
+            return Float4(m[r][0]) * p.x + Float4(m[r][1]) * p.y + Float4(m[r][2]) * p.z + Float4(m[r][3]);
+        };
+        std::array<float, 4> lanes_out[8];
+        for (int r = 0; r < 4; ++r) {
+            row(clip, r).store(lanes_out[r]);
+        }
+        (Float4(1.f) / Float4::load(lanes_out[3])).store(lanes_out[4]);
+        for (int r = 0; r < 3; ++r) {
+            row(world, r).store(lanes_out[5 + r]);
+        }
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            Vertex& vertex = out[i + lane];
+            vertex.clip_position = {lanes_out[0][lane], lanes_out[1][lane], lanes_out[2][lane], lanes_out[3][lane]};
+            vertex.reciprocal_w = lanes_out[4][lane];
+            vertex.world_position = {lanes_out[5][lane], lanes_out[6][lane], lanes_out[7][lane]};
+        }
+    }
+}
+
+// out[i] = transform_direction(world, normals[i]), four per Float4.
+void transform_normals(const Mat4f& world, const Vec3f* normals, size_t count, Vec3f* out) {
+    for (size_t i = 0; i < count; i += 4) {
+        size_t lanes = std::min<size_t>(4, count - i);
+        std::array<float, 4> x{};
+        std::array<float, 4> y{};
+        std::array<float, 4> z{};
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            x[lane] = normals[i + lane].x;
+            y[lane] = normals[i + lane].y;
+            z[lane] = normals[i + lane].z;
+        }
+        Vec3f4 n{Float4::load(x), Float4::load(y), Float4::load(z)};
+        // The w = 0 term is kept so signed zeros match the scalar path.
+        auto row = [&](int r) {
+            return Float4(world[r][0]) * n.x + Float4(world[r][1]) * n.y + Float4(world[r][2]) * n.z +
+                   Float4(world[r][3]) * Float4(0.f);
+        };
+        Vec3f4 result = normalize(Vec3f4{row(0), row(1), row(2)});
+        result.x.store(x);
+        result.y.store(y);
+        result.z.store(z);
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            out[i + lane] = {x[lane], y[lane], z[lane]};
+        }
+    }
+}
+
+size_t depth_bytes(DepthFormat format) {
+    switch (format) {
+        case DepthFormat::Unorm24: return 3;
+        case DepthFormat::Unorm16: return 2;
+        default: return 4;
+    }
+}
+
+// Standard 4x rotated-grid pattern, in pixels from the pixel center.
+constexpr float kSampleOffsets[4][2] = {
+    {-0.125f, -0.375f}, {0.375f, -0.125f}, {-0.375f, 0.125f}, {0.125f, 0.375f}};
+
+// out[i] = rounded mean of the four sample bytes.
+void average_samples(const uint8_t* s0,
+                     const uint8_t* s1,
+                     const uint8_t* s2,
+                     const uint8_t* s3,
+                     uint8_t* out,
+                     size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(2);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s0 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s1 + i));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s2 + i));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s3 + i));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                                   _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                                   _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, bias), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, bias), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = static_cast<uint8_t>((s0[i] + s1[i] + s2[i] + s3[i] + 2) >> 2);
+    }
+}
+
+template <DepthFormat kFormat>
+struct DepthTraits;
+
+template <>
+struct DepthTraits<DepthFormat::Float32> {
+    using Value = float;
+    static Value clear() { return std::numeric_limits<float>::infinity(); }
+    static Value encode(float depth) { return depth; }
+    static bool passes(Value depth, Value stored) { return depth < stored; }
+    static Value load(const void* base, size_t index) { return static_cast<const float*>(base)[index]; }
+    static void store(void* base, size_t index, Value depth) { static_cast<float*>(base)[index] = depth; }
+};
+
+template <>
+struct DepthTraits<DepthFormat::ReversedFloat32> {
+    using Value = float;
+    static Value clear() { return -std::numeric_limits<float>::infinity(); }
+    static Value encode(float depth) { return depth; }
+    static bool passes(Value depth, Value stored) { return depth > stored; }
+    static Value load(const void* base, size_t index) { return static_cast<const float*>(base)[index]; }
+    static void store(void* base, size_t index, Value depth) { static_cast<float*>(base)[index] = depth; }
+};
+
+// The all-ones code is reserved for the clear value so that depths at or
+// beyond the far plane still pass against a cleared pixel, as they do in
+// the float formats.
+template <uint32_t kMax>
+uint32_t quantize_depth(float depth) {
+    if (!(depth >= 0.f)) {
+        return depth < 0.f ? 0u : kMax;
+    }
+    if (depth >= 1.f) {
+        return kMax - 1;
+    }
+    return static_cast<uint32_t>(depth * static_cast<float>(kMax - 1) + 0.5f);
+}
+
+template <>
+struct DepthTraits<DepthFormat::Unorm24> {
+    using Value = uint32_t;
+    static constexpr uint32_t kMax = 0xffffff;
+    static Value clear() { return kMax; }
+    static Value encode(float depth) { return quantize_depth<kMax>(depth); }
+    static bool passes(Value depth, Value stored) { return depth < stored; }
+    static Value load(const void* base, size_t index) {
+        const uint8_t* p = static_cast<const uint8_t*>(base) + index * 3;
+        return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16;
+    }
+    static void store(void* base, size_t index, Value depth) {
+        uint8_t* p = static_cast<uint8_t*>(base) + index * 3;
+        p[0] = static_cast<uint8_t>(depth);
+        p[1] = static_cast<uint8_t>(depth >> 8);
+        p[2] = static_cast<uint8_t>(depth >> 16);
+    }
+};
+
+template <>
+struct DepthTraits<DepthFormat::Unorm16> {
+    using Value = uint32_t;
+    static constexpr uint32_t kMax = 0xffff;
+    static Value clear() { return kMax; }
+    static Value encode(float depth) { return quantize_depth<kMax>(depth); }
+    static bool passes(Value depth, Value stored) { return depth < stored; }
+    static Value load(const void* base, size_t index) { return static_cast<const uint16_t*>(base)[index]; }
+    static void store(void* base, size_t index, Value depth) {
+        static_cast<uint16_t*>(base)[index] = static_cast<uint16_t>(depth);
+    }
+};
+}
+
+void Rasterizer::FrameCounters::reset() {
+    triangles_culled.store(0);
+    triangles_bbox_clamped.store(0);
+    pixels_tested.store(0);
+    depth_tests.store(0);
+    depth_passed.store(0);
+    fragments_shaded.store(0);
+    pixels_covered.store(0);
+    shade_ns.store(0);
+    tile_ns.store(0);
+}
 
 Rasterizer::Rasterizer(int width, int height)
-    : color_buffer_(width, height),
-      depth_buffer_(static_cast<size_t>(width) * height, std::numeric_limits<float>::infinity()) {
-    color_buffer_.clear({0.f, 0.f, 0.f});
+    : Rasterizer(RenderRegion::full_frame(width, height)) {}
+
+Rasterizer::Rasterizer(const RenderRegion& region) : Rasterizer(region, nullptr, nullptr) {}
+
+Rasterizer::Rasterizer(const RenderRegion& region, uint8_t* color, float* depth)
+    : region_(region),
+      color_buffer_(color ? Image::view(region.width(), region.height(), color)
+                          : Image(region.width(), region.height())),
+      depth_storage_(depth ? 0 : static_cast<size_t>(region.width()) * region.height() * sizeof(float)),
+      depth_(depth ? static_cast<void*>(depth) : depth_storage_.data()),
+      tiles_x_((region.width() + kTileSize - 1) / kTileSize),
+      tiles_y_((region.height() + kTileSize - 1) / kTileSize),
+      arena_(sizeof(BinChunk)) {
+    if (region.x0 < 0 || region.y0 < 0 || region.x1 > region.frame_width ||
+        region.y1 > region.frame_height || region.width() <= 0 || region.height() <= 0) {
+        throw std::invalid_argument("Render region must be a non-empty part of the frame");
+    }
+    external_target_ = color || depth;
+    sample_plane_ = static_cast<size_t>(region.width()) * region.height();
+    tile_state_.assign(static_cast<size_t>(tiles_x_) * tiles_y_, kTileResolved);
+    if (!color) {
+        color_buffer_.clear(clear_color_);
+    }
+    if (!depth) {
+        fill_depth(0, static_cast<size_t>(region.width()) * region.height());
+    }
+}
+
+const char* framebuffer_layout_name(FramebufferLayout layout) {
+    switch (layout) {
+        case FramebufferLayout::Tiled: return "tiled";
+        case FramebufferLayout::Morton: return "morton";
+        default: return "linear";
+    }
+}
+
+const char* depth_format_name(DepthFormat format) {
+    switch (format) {
+        case DepthFormat::ReversedFloat32: return "reversed";
+        case DepthFormat::Unorm24: return "unorm24";
+        case DepthFormat::Unorm16: return "unorm16";
+        default: return "float32";
+    }
+}
+
+bool parse_depth_format(const std::string& name, DepthFormat& format) {
+    for (DepthFormat candidate :
+         {DepthFormat::Float32, DepthFormat::ReversedFloat32, DepthFormat::Unorm24, DepthFormat::Unorm16}) {
+        if (name == depth_format_name(candidate)) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* shading_rate_mode_name(ShadingRateMode mode) {
+    switch (mode) {
+        case ShadingRateMode::Coarse2x2: return "2x2";
+        case ShadingRateMode::Coarse4x4: return "4x4";
+        case ShadingRateMode::Adaptive: return "adaptive";
+        case ShadingRateMode::Image: return "image";
+        default: return "full";
+    }
+}
+
+bool parse_shading_rate_mode(const std::string& name, ShadingRateMode& mode) {
+    for (ShadingRateMode candidate : {ShadingRateMode::Full, ShadingRateMode::Coarse2x2, ShadingRateMode::Coarse4x4,
+                                      ShadingRateMode::Adaptive}) {
+        if (name == shading_rate_mode_name(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* cluster_culling_name(ClusterCulling mode) {
+    switch (mode) {
+        case ClusterCulling::Frustum: return "frustum";
+        case ClusterCulling::FrustumCone: return "frustum-cone";
+        default: return "off";
+    }
+}
+
+bool parse_cluster_culling(const std::string& name, ClusterCulling& mode) {
+    for (ClusterCulling candidate : {ClusterCulling::Off, ClusterCulling::Frustum, ClusterCulling::FrustumCone}) {
+        if (name == cluster_culling_name(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* draw_order_name(DrawOrder order) {
+    return order == DrawOrder::FrontToBack ? "front-to-back" : "submission";
+}
+
+bool parse_draw_order(const std::string& name, DrawOrder& order) {
+    for (DrawOrder candidate : {DrawOrder::Submission, DrawOrder::FrontToBack}) {
+        if (name == draw_order_name(candidate)) {
+            order = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_framebuffer_layout(const std::string& name, FramebufferLayout& layout) {
+    for (FramebufferLayout candidate : {FramebufferLayout::Linear, FramebufferLayout::Tiled, FramebufferLayout::Morton}) {
+        if (name == framebuffer_layout_name(candidate)) {
+            layout = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Rasterizer::set_framebuffer_layout(FramebufferLayout layout) {
+    if (layout == layout_) {
+        return;
+    }
+    if (external_target_ && layout != FramebufferLayout::Linear) {
+        throw std::invalid_argument("Caller-owned render targets must use the linear layout");
+    }
+    resolve_clears();
+    layout_ = layout;
+    allocate_working_buffers();
+}
+
+void Rasterizer::set_depth_format(DepthFormat format) {
+    if (format == depth_format_) {
+        return;
+    }
+    if (external_target_ && format != DepthFormat::Float32) {
+        throw std::invalid_argument("Caller-owned render targets must use the float32 depth format");
+    }
+    resolve_clears();
+    depth_format_ = format;
+    allocate_working_buffers();
+}
+
+void Rasterizer::set_sample_count(int samples) {
+    if (samples == samples_) {
+        return;
+    }
+    if (samples != 1 && samples != kMsaaSamples) {
+        throw std::invalid_argument("Sample count must be 1 or 4");
+    }
+    if (external_target_) {
+        throw std::invalid_argument("Caller-owned render targets must be single-sampled");
+    }
+    resolve_clears();
+    samples_ = samples;
+    allocate_working_buffers();
+}
+
+void Rasterizer::set_occlusion_culling(const OcclusionCullingConfig& config) {
+    if (config.buffer_scale <= 0) {
+        throw std::invalid_argument("Occlusion buffer scale must be positive");
+    }
+    occlusion_ = config;
+    occlusion_buffer_ = OcclusionBuffer();
+}
+
+void Rasterizer::set_shading_rate(ShadingRateConfig config) {
+    if (config.mode == ShadingRateMode::Image &&
+        config.tile_rates.size() != static_cast<size_t>(tile_count(region_))) {
+        throw std::invalid_argument("Shading rate image needs one rate per tile");
+    }
+    shading_rate_ = std::move(config);
+}
+
+void Rasterizer::allocate_working_buffers() {
+    int width = color_buffer_.width();
+    int height = color_buffer_.height();
+    size_t pixels = static_cast<size_t>(width) * height;
+    if (layout_ != FramebufferLayout::Linear) {
+        blocks_x_ = (width + kBlockSize - 1) / kBlockSize;
+        int blocks_y = (height + kBlockSize - 1) / kBlockSize;
+        pixels = static_cast<size_t>(blocks_x_) * blocks_y * kBlockSize * kBlockSize;
+    }
+    sample_plane_ = pixels;
+    size_t samples = pixels * static_cast<size_t>(samples_);
+    if (layout_ != FramebufferLayout::Linear && samples_ == 1) {
+        tiled_color_.assign(pixels * 3, 0);
+    } else {
+        tiled_color_ = {};
+    }
+    if (samples_ > 1) {
+        sample_color_.assign(samples * 3, 0);
+    } else {
+        sample_color_ = {};
+    }
+    depth_storage_.assign(samples * depth_bytes(depth_format_), 0);
+    depth_ = depth_storage_.data();
+    fill_depth(0, samples);
+}
+
+void Rasterizer::fill_depth(size_t offset, size_t count) {
+    switch (depth_format_) {
+        case DepthFormat::Float32:
+        case DepthFormat::ReversedFloat32: {
+            float* depth = static_cast<float*>(depth_) + offset;
+            float clear = depth_format_ == DepthFormat::Float32 ? DepthTraits<DepthFormat::Float32>::clear()
+                                                                : DepthTraits<DepthFormat::ReversedFloat32>::clear();
+            std::fill(depth, depth + count, clear);
+            break;
+        }
+        case DepthFormat::Unorm24:
+            std::memset(static_cast<uint8_t*>(depth_) + offset * 3, 0xff, count * 3);
+            break;
+        case DepthFormat::Unorm16:
+            std::memset(static_cast<uint16_t*>(depth_) + offset, 0xff, count * 2);
+            break;
+    }
+}
+
+int Rasterizer::tile_count(const RenderRegion& region) {
+    return ((region.width() + kTileSize - 1) / kTileSize) * ((region.height() + kTileSize - 1) / kTileSize);
 }
 
 Vec3f Rasterizer::barycentric(const std::array<float, 2>& a,
@@ -27,67 +477,1560 @@ Vec3f Rasterizer::barycentric(const std::array<float, 2>& a,
     return {1.f - u_coord - v_coord, u_coord, v_coord};
 }
 
-void Rasterizer::render(const Model& model, IShader& shader) {
-    color_buffer_.clear({0.f, 0.f, 0.f});
-    std::fill(depth_buffer_.begin(), depth_buffer_.end(), std::numeric_limits<float>::infinity());
+void Rasterizer::parallel_for(size_t count, size_t grain, const JobSystem::RangeFn& fn) {
+    if (jobs_) {
+        jobs_->parallel_for(0, count, grain, fn);
+    } else if (count > 0) {
+        fn(0, count);
+    }
+}
 
-    int width = color_buffer_.width();
-    int height = color_buffer_.height();
+RenderStats Rasterizer::render(const Model& model, IShader& shader) {
+    TRACE_SCOPE("Rasterizer::render");
+    auto frame_start = StatsClock::now();
+    int workers = begin_frame();
+
+    begin_stage(RenderStage::Clear);
+    if (!tile_source_) {
+        clear_buffers();
+    } else {
+        std::fill(tile_state_.begin(), tile_state_.end(), kTileResolved);
+        if (debug_mode_ == DebugMode::DepthComplexity) {
+            complexity_.reset(color_buffer_.width(), color_buffer_.height());
+        }
+    }
+    end_stage(RenderStage::Clear);
+    auto clear_end = StatsClock::now();
+
+    vertex_stage(model, shader);
+    auto vertex_end = StatsClock::now();
+
+    setup_stage();
+    auto setup_end = StatsClock::now();
+
+    tile_stage(shader, workers);
+    auto raster_end = StatsClock::now();
+
+    stats_.clear_ms = elapsed_ms(frame_start, clear_end);
+    stats_.vertex_ms = elapsed_ms(clear_end, vertex_end);
+    stats_.setup_ms = elapsed_ms(vertex_end, setup_end);
+    split_tile_time(elapsed_ms(setup_end, raster_end));
+    stats_.total_ms = elapsed_ms(frame_start, raster_end);
+    publish_counters();
+    return stats_;
+}
+
+RenderStats Rasterizer::render(const Scene& scene) {
+    TRACE_SCOPE("Rasterizer::render scene");
+    if (tile_source_) {
+        throw std::invalid_argument("Scene rendering does not support a tile source");
+    }
+    auto frame_start = StatsClock::now();
+    int workers = begin_frame();
+
+    begin_stage(RenderStage::Clear);
+    clear_buffers();
+    end_stage(RenderStage::Clear);
+    auto clear_end = StatsClock::now();
+
+    const auto& draws = scene.draws();
+    scene_shaders_.assign(draws.size(), scene.shading());
+    for (size_t draw = 0; draw < draws.size(); ++draw) {
+        scene_shaders_[draw].set_material(draws[draw].material);
+    }
+    draw_shaders_ = scene_shaders_.data();
+    begin_stage(RenderStage::Vertex);
+    cull_instances(scene);
+    end_stage(RenderStage::Vertex);
+    stats_.vertex_ms = elapsed_ms(clear_end, StatsClock::now());
+
+    double tile_phase_ms = 0.0;
+    uint64_t submitted = 0;
+    triangle_count_ = 0;
+    for (size_t next = 0; next < scene_instances_.size();) {
+        auto pass_start = StatsClock::now();
+        if (next > 0) {
+            // Drops the previous pass's triangles and bins; the peak memory
+            // stats survive.
+            arena_.begin_frame();
+        }
+        begin_stage(RenderStage::Vertex);
+        next = begin_scene_pass(scene, next);
+        const PassInstance& last = pass_instances_[pass_instance_count_ - 1];
+        parallel_for(last.first_vertex + last.model->vertices().size(), kSceneVertexGrain,
+                     [&](size_t begin, size_t end) {
+                         TRACE_SCOPE("instance vertices");
+                         transform_pass_vertices(begin, end);
+                     });
+        parallel_for(last.first_normal + last.model->normals().size(), kSceneVertexGrain,
+                     [&](size_t begin, size_t end) {
+                         TRACE_SCOPE("instance normals");
+                         transform_pass_normals(begin, end);
+                     });
+        parallel_for(triangle_count_, 1024, [&](size_t begin, size_t end) {
+            TRACE_SCOPE("vertex");
+            assemble_pass_triangles(begin, end);
+        });
+        end_stage(RenderStage::Vertex);
+        auto vertex_end = StatsClock::now();
+
+        setup_stage();
+        auto setup_end = StatsClock::now();
+
+        tile_stage(scene.shading(), workers);
+        auto raster_end = StatsClock::now();
+
+        stats_.vertex_ms += elapsed_ms(pass_start, vertex_end);
+        stats_.setup_ms += elapsed_ms(vertex_end, setup_end);
+        tile_phase_ms += elapsed_ms(setup_end, raster_end);
+        submitted += triangle_count_;
+        ++stats_.scene_passes;
+    }
+    draw_shaders_ = nullptr;
+
+    stats_.clear_ms = elapsed_ms(frame_start, clear_end);
+    split_tile_time(tile_phase_ms);
+    stats_.total_ms = elapsed_ms(frame_start, StatsClock::now());
+    stats_.instances_drawn = scene_instances_.size();
+    publish_counters();
+    stats_.triangles_submitted = submitted;
+    return stats_;
+}
+
+RenderStats Rasterizer::render_bands(const Model& model, IShader& shader, IRowSink& sink) {
+    TRACE_SCOPE("Rasterizer::render_bands");
+    if (region_.x0 != 0 || region_.x1 != region_.frame_width || region_.y0 != 0) {
+        throw std::invalid_argument("Band rendering needs a full-width region at the top of the frame");
+    }
+    auto frame_start = StatsClock::now();
+    const RenderRegion band_shape = region_;
+    const int band_rows = band_shape.height();
+    const size_t band_count = static_cast<size_t>((region_.frame_height + band_rows - 1) / band_rows);
+    int workers = begin_frame();
+
+    auto vertex_start = StatsClock::now();
+    vertex_stage(model, shader);
+    auto vertex_end = StatsClock::now();
+
+    // Triangles are sorted into bands once; each band then only bins the
+    // triangles that reach it.
+    batch_count_ = (triangle_count_ + kBinBatch - 1) / kBinBatch;
+    band_bins_ = arena_.linear(0).allocate_array<BinList>(batch_count_ * band_count);
+    std::fill(band_bins_, band_bins_ + batch_count_ * band_count, BinList{nullptr, nullptr});
+    begin_stage(RenderStage::Setup);
+    sort_draw_order();
+    parallel_for(batch_count_, 1, [&](size_t begin, size_t end) {
+        for (size_t batch = begin; batch < end; ++batch) {
+            TRACE_SCOPE_ARG("band bin", static_cast<int64_t>(batch));
+            bin_bands(batch, band_rows, band_count);
+        }
+    });
+    end_stage(RenderStage::Setup);
+    stats_.setup_ms = elapsed_ms(vertex_end, StatsClock::now());
+    stats_.vertex_ms = elapsed_ms(vertex_start, vertex_end);
+
+    size_t max_tiles = static_cast<size_t>(tiles_x_) * tiles_y_;
+    bins_ = arena_.linear(0).allocate_array<BinList>(batch_count_ * max_tiles);
+    double tile_phase_ms = 0.0;
+    try {
+        for (size_t band = 0; band < band_count; ++band) {
+            auto band_start = StatsClock::now();
+            region_.y0 = static_cast<int>(band) * band_rows;
+            region_.y1 = std::min(region_.frame_height, region_.y0 + band_rows);
+            tiles_y_ = (region_.height() + kTileSize - 1) / kTileSize;
+
+            begin_stage(RenderStage::Clear);
+            clear_buffers();
+            end_stage(RenderStage::Clear);
+            auto clear_end = StatsClock::now();
+
+            size_t tile_count = static_cast<size_t>(tiles_x_) * tiles_y_;
+            std::fill(bins_, bins_ + batch_count_ * tile_count, BinList{nullptr, nullptr});
+            begin_stage(RenderStage::Setup);
+            parallel_for(batch_count_, 1, [&](size_t begin, size_t end) {
+                for (size_t batch = begin; batch < end; ++batch) {
+                    TRACE_SCOPE_ARG("bin", static_cast<int64_t>(batch));
+                    bin_band_triangles(batch, band, band_count);
+                }
+            });
+            end_stage(RenderStage::Setup);
+            auto setup_end = StatsClock::now();
+
+            tile_stage(shader, workers);
+            auto raster_end = StatsClock::now();
+            arena_.reset_bins();
+
+            resolve_clears();
+            bool written = sink.write_rows(color_buffer_.data(), region_.height());
+            auto write_end = StatsClock::now();
+            if (!written) {
+                throw std::runtime_error("Failed to write rendered rows");
+            }
+            stats_.clear_ms += elapsed_ms(band_start, clear_end);
+            stats_.setup_ms += elapsed_ms(clear_end, setup_end);
+            tile_phase_ms += elapsed_ms(setup_end, raster_end);
+            stats_.encode_ms += elapsed_ms(raster_end, write_end);
+        }
+    } catch (...) {
+        region_ = band_shape;
+        tiles_y_ = (region_.height() + kTileSize - 1) / kTileSize;
+        throw;
+    }
+    region_ = band_shape;
+    tiles_y_ = (region_.height() + kTileSize - 1) / kTileSize;
+
+    split_tile_time(tile_phase_ms);
+    stats_.total_ms = elapsed_ms(frame_start, StatsClock::now());
+    publish_counters();
+    return stats_;
+}
+
+int Rasterizer::begin_frame() {
+    stats_ = RenderStats{};
+    counters_.reset();
+    int workers = jobs_ ? jobs_->worker_count() : 1;
+    if (arena_.worker_count() != workers) {
+        arena_.set_worker_count(workers);
+    }
+    arena_.begin_frame();
+    shade_queues_.resize(static_cast<size_t>(workers));
+    draw_shaders_ = nullptr;
+    return workers;
+}
+
+void Rasterizer::clear_buffers() {
+    TRACE_SCOPE("clear");
+    // Fast clear: tiles are only flagged here. A tile's color and depth are
+    // written when the first triangle reaches it, or at resolve time.
+    std::fill(tile_state_.begin(), tile_state_.end(), kTileCleared);
+    if (debug_mode_ == DebugMode::DepthComplexity) {
+        complexity_.reset(color_buffer_.width(), color_buffer_.height());
+    }
+}
+
+void Rasterizer::vertex_stage(const Model& model, IShader& shader) {
+    begin_stage(RenderStage::Vertex);
+    cull_geometry(model, shader);
+    triangles_ = arena_.linear(0).allocate_array<Triangle>(triangle_count_);
+    depth_keys_ = draw_order_ == DrawOrder::FrontToBack && triangle_count_ > 0
+                      ? arena_.linear(0).allocate_array<uint16_t>(triangle_count_)
+                      : nullptr;
+    parallel_for(triangle_count_, 1024, [&](size_t begin, size_t end) {
+        TRACE_SCOPE("vertex");
+        transform_vertices(model, shader, begin, end);
+    });
+    end_stage(RenderStage::Vertex);
+}
+
+void Rasterizer::setup_stage() {
+    size_t tile_count = static_cast<size_t>(tiles_x_) * tiles_y_;
+    batch_count_ = (triangle_count_ + kBinBatch - 1) / kBinBatch;
+    bins_ = arena_.linear(0).allocate_array<BinList>(batch_count_ * tile_count);
+    std::fill(bins_, bins_ + batch_count_ * tile_count, BinList{nullptr, nullptr});
+    begin_stage(RenderStage::Setup);
+    sort_draw_order();
+    parallel_for(batch_count_, 1, [&](size_t begin, size_t end) {
+        for (size_t batch = begin; batch < end; ++batch) {
+            TRACE_SCOPE_ARG("bin", static_cast<int64_t>(batch));
+            bin_triangles(batch);
+        }
+    });
+    end_stage(RenderStage::Setup);
+}
+
+// Fills scene_instances_ with the instances to draw, in draw order. With
+// cluster culling on, instances whose world bounds lie outside the frustum
+// are dropped.
+void Rasterizer::cull_instances(const Scene& scene) {
+    TRACE_SCOPE("instance cull");
+    scene_instances_.clear();
+    const PhongShader& shading = scene.shading();
+    std::optional<Frustum> frustum;
+    if (cluster_culling_ != ClusterCulling::Off) {
+        frustum = Frustum::from_matrix(shading.projection_matrix() * shading.view_matrix(),
+                                       depth_format_ == DepthFormat::ReversedFloat32);
+    }
+    const auto& draws = scene.draws();
+    for (size_t d = 0; d < draws.size(); ++d) {
+        const DrawItem& draw = draws[d];
+        size_t faces = draw.model->face_count();
+        if (faces == 0) {
+            continue;
+        }
+        size_t count = draw.instances.size();
+        instance_visible_.assign(count, 1);
+        if (frustum) {
+            const Aabb& bounds = draw.model->bounds();
+            frustum->intersects_boxes(count, [&](size_t i) { return transform_box(draw.instances[i], bounds); },
+                                      instance_visible_.data());
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (instance_visible_[i]) {
+                scene_instances_.push_back({static_cast<uint32_t>(d), static_cast<uint32_t>(i)});
+            } else {
+                ++stats_.instances_outside;
+                stats_.triangles_cluster_culled += faces;
+            }
+        }
+    }
+}
+
+// Takes the instances from first on until the pass would exceed
+// kScenePassTriangles, but at least one, and allocates the pass's arrays.
+// Returns the first instance of the next pass.
+size_t Rasterizer::begin_scene_pass(const Scene& scene, size_t first) {
+    const auto& draws = scene.draws();
+    size_t end = first;
+    size_t triangles = 0;
+    while (end < scene_instances_.size()) {
+        size_t faces = draws[scene_instances_[end].draw].model->face_count();
+        if (end > first && triangles + faces > kScenePassTriangles) {
+            break;
+        }
+        triangles += faces;
+        ++end;
+    }
+
+    LinearAllocator& linear = arena_.linear(0);
+    pass_instance_count_ = end - first;
+    pass_instances_ = linear.allocate_array<PassInstance>(pass_instance_count_);
+    const PhongShader& shading = scene.shading();
+    // Same product as PhongShader::set_matrices.
+    Mat4f view_projection = shading.projection_matrix() * shading.view_matrix();
+    size_t next_triangle = 0;
+    size_t next_vertex = 0;
+    size_t next_normal = 0;
+    for (size_t k = 0; k < pass_instance_count_; ++k) {
+        const SceneInstance& instance = scene_instances_[first + k];
+        const DrawItem& draw = draws[instance.draw];
+        const Mat4f& world = draw.instances[instance.instance];
+        pass_instances_[k] = {draw.model, instance.draw, view_projection * world, world,
+                              next_triangle, next_vertex, next_normal};
+        next_triangle += draw.model->face_count();
+        next_vertex += draw.model->vertices().size();
+        next_normal += draw.model->normals().size();
+    }
+    pass_vertices_ = linear.allocate_array<TransformedVertex>(next_vertex);
+    pass_normals_ = linear.allocate_array<Vec3f>(next_normal);
+
+    triangle_count_ = triangles;
+    visible_faces_ = nullptr;
+    triangles_ = linear.allocate_array<Triangle>(triangle_count_);
+    depth_keys_ = draw_order_ == DrawOrder::FrontToBack ? linear.allocate_array<uint16_t>(triangle_count_) : nullptr;
+    return end;
+}
+
+void Rasterizer::transform_pass_vertices(size_t begin, size_t end) {
+    size_t k = containing_range(pass_instances_, pass_instance_count_, &PassInstance::first_vertex, begin);
+    for (size_t offset = begin; offset < end; ++k) {
+        const PassInstance& instance = pass_instances_[k];
+        const auto& vertices = instance.model->vertices();
+        size_t from = offset - instance.first_vertex;
+        size_t to = std::min(vertices.size(), end - instance.first_vertex);
+        transform_positions(instance.clip, instance.world, vertices.data() + from, to - from, pass_vertices_ + offset);
+        offset = instance.first_vertex + to;
+    }
+}
+
+void Rasterizer::transform_pass_normals(size_t begin, size_t end) {
+    size_t k = containing_range(pass_instances_, pass_instance_count_, &PassInstance::first_normal, begin);
+    for (size_t offset = begin; offset < end; ++k) {
+        const PassInstance& instance = pass_instances_[k];
+        const auto& normals = instance.model->normals();
+        size_t from = offset - instance.first_normal;
+        size_t to = std::min(normals.size(), end - instance.first_normal);
+        transform_normals(instance.world, normals.data() + from, to - from, pass_normals_ + offset);
+        offset = instance.first_normal + to;
+    }
+}
+
+void Rasterizer::assemble_pass_triangles(size_t begin, size_t end) {
+    size_t k = containing_range(pass_instances_, pass_instance_count_, &PassInstance::first_triangle, begin);
+    for (size_t id = begin; id < end; ++id) {
+        while (k + 1 < pass_instance_count_ && pass_instances_[k + 1].first_triangle <= id) {
+            ++k;
+        }
+        const PassInstance& instance = pass_instances_[k];
+        size_t face = id - instance.first_triangle;
+        auto vertex_ids = instance.model->face_vertex_indices(face);
+        auto normal_ids = instance.model->face_normal_indices(face);
+        Triangle& tri = triangles_[id];
+        for (int i = 0; i < 3; ++i) {
+            const TransformedVertex& vertex = pass_vertices_[instance.first_vertex + static_cast<size_t>(vertex_ids[i])];
+            tri.verts[i].payload = {vertex.clip_position, vertex.world_position,
+                                    pass_normals_[instance.first_normal + static_cast<size_t>(normal_ids[i])],
+                                    vertex.reciprocal_w};
+        }
+        tri.draw = instance.draw;
+        project_vertices(id);
+    }
+}
+
+// Sets triangle_count_ and visible_faces_ for the vertex stage.
+void Rasterizer::cull_geometry(const Model& model, const IShader& shader) {
+    triangle_count_ = model.face_count();
+    visible_faces_ = nullptr;
+    const auto& objects = model.objects();
+    bool occlusion = occlusion_.enabled && objects.size() > 1;
+    bool clusters = cluster_culling_ != ClusterCulling::Off;
+    std::optional<Mat4f> clip = occlusion || clusters ? shader.clip_transform() : std::nullopt;
+    if (!clip) {
+        return;
+    }
+    LinearAllocator& linear = arena_.linear(0);
+    auto* object_visible = linear.allocate_array<uint8_t>(objects.size());
+    Frustum frustum = Frustum::from_matrix(*clip, depth_format_ == DepthFormat::ReversedFloat32);
+    if (clusters) {
+        TRACE_SCOPE("frustum cull");
+        frustum.intersects_boxes(objects.size(), [&](size_t i) -> const Aabb& { return objects[i].bounds; },
+                                 object_visible);
+        for (size_t i = 0; i < objects.size(); ++i) {
+            stats_.objects_outside += object_visible[i] ? 0 : 1;
+            stats_.triangles_cluster_culled += object_visible[i] ? 0 : objects[i].face_count;
+        }
+    } else {
+        std::fill(object_visible, object_visible + objects.size(), uint8_t{1});
+    }
+    if (occlusion) {
+        cull_occluded_objects(model, *clip, object_visible);
+    }
+    const auto& meshlets = model.meshlets();
+    uint8_t* meshlet_visible = nullptr;
+    if (clusters) {
+        meshlet_visible = linear.allocate_array<uint8_t>(meshlets.size());
+        cull_clusters(model, frustum, *clip, object_visible, meshlet_visible);
+    }
 
-    std::array<RasterVertex, 3> verts;
+    // Surviving faces are compacted in face order, so culling never changes
+    // the submission order.
+    const auto& meshlet_faces = model.meshlet_faces();
+    auto* face_visible = linear.allocate_array<uint8_t>(triangle_count_);
+    parallel_for(objects.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const ModelObject& object = objects[i];
+            if (!object_visible[i] || !meshlet_visible) {
+                std::fill_n(face_visible + object.first_face, object.face_count, object_visible[i]);
+                continue;
+            }
+            for (size_t m = object.first_meshlet; m < object.first_meshlet + object.meshlet_count; ++m) {
+                for (size_t k = 0; k < meshlets[m].face_count; ++k) {
+                    face_visible[meshlet_faces[meshlets[m].face_offset + k]] = meshlet_visible[m];
+                }
+            }
+        }
+    });
+    size_t visible = 0;
+    for (size_t face = 0; face < triangle_count_; ++face) {
+        visible += face_visible[face];
+    }
+    if (visible == triangle_count_) {
+        return;
+    }
+    auto* faces = linear.allocate_array<uint32_t>(visible);
+    size_t next = 0;
+    for (size_t face = 0; face < triangle_count_; ++face) {
+        if (face_visible[face]) {
+            faces[next++] = static_cast<uint32_t>(face);
+        }
+    }
+    triangle_count_ = visible;
+    visible_faces_ = faces;
+}
 
-    for (size_t face = 0; face < model.face_count(); ++face) {
+// Sets meshlet_visible for every meshlet; meshlets of hidden objects are
+// skipped without testing.
+void Rasterizer::cull_clusters(const Model& model,
+                               const Frustum& frustum,
+                               const Mat4f& clip,
+                               const uint8_t* object_visible,
+                               uint8_t* meshlet_visible) {
+    TRACE_SCOPE("cluster cull");
+    enum : uint8_t { kOutside, kVisible, kBackFacing, kHidden };
+    const auto& objects = model.objects();
+    const auto& meshlets = model.meshlets();
+    std::optional<Vec3f> eye = cluster_culling_ == ClusterCulling::FrustumCone ? clip_eye(clip) : std::nullopt;
+    auto* verdict = arena_.linear(0).allocate_array<uint8_t>(meshlets.size());
+    parallel_for(objects.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t first = objects[i].first_meshlet;
+            size_t count = objects[i].meshlet_count;
+            if (!object_visible[i]) {
+                std::fill_n(verdict + first, count, kHidden);
+                continue;
+            }
+            // Writes kVisible or kOutside.
+            frustum.intersects_spheres(count, [&](size_t k) -> const BoundingSphere& { return meshlets[first + k].sphere; },
+                                       verdict + first);
+            for (size_t m = first; eye && m < first + count; ++m) {
+                const Meshlet& meshlet = meshlets[m];
+                Vec3f view = meshlet.sphere.center - *eye;
+                if (verdict[m] == kVisible &&
+                    dot(view, meshlet.cone_axis) >= meshlet.cone_cutoff * length(view) + meshlet.sphere.radius) {
+                    verdict[m] = kBackFacing;
+                }
+            }
+        }
+    });
+    for (size_t m = 0; m < meshlets.size(); ++m) {
+        meshlet_visible[m] = verdict[m] == kVisible;
+        stats_.clusters_tested += verdict[m] != kHidden ? 1 : 0;
+        stats_.clusters_outside += verdict[m] == kOutside ? 1 : 0;
+        stats_.clusters_back_facing += verdict[m] == kBackFacing ? 1 : 0;
+        stats_.triangles_cluster_culled +=
+            verdict[m] == kOutside || verdict[m] == kBackFacing ? meshlets[m].face_count : 0;
+    }
+}
+
+// Clears object_visible for objects hidden behind the occluders.
+void Rasterizer::cull_occluded_objects(const Model& model, const Mat4f& clip, uint8_t* object_visible) {
+    TRACE_SCOPE("occlusion");
+    const auto& objects = model.objects();
+    if (occlusion_buffer_.width() != region_.frame_width || occlusion_buffer_.height() != region_.frame_height) {
+        occlusion_buffer_.resize(region_.frame_width, region_.frame_height, occlusion_.buffer_scale);
+    } else {
+        occlusion_buffer_.clear();
+    }
+    occlusion_buffer_.set_reversed_z(depth_format_ == DepthFormat::ReversedFloat32);
+
+    // Objects crossing the near plane can neither occlude nor be culled.
+    LinearAllocator& linear = arena_.linear(0);
+    auto* bounds = linear.allocate_array<ScreenBounds>(objects.size());
+    auto* projected = linear.allocate_array<uint8_t>(objects.size());
+    parallel_for(objects.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            projected[i] = object_visible[i] && occlusion_buffer_.project(clip, objects[i].bounds, bounds[i]);
+        }
+    });
+    float frame_area = static_cast<float>(region_.frame_width) * static_cast<float>(region_.frame_height);
+    auto area = [&](size_t i) {
+        float w = std::clamp(bounds[i].x1, 0.f, static_cast<float>(region_.frame_width)) -
+                  std::clamp(bounds[i].x0, 0.f, static_cast<float>(region_.frame_width));
+        float h = std::clamp(bounds[i].y1, 0.f, static_cast<float>(region_.frame_height)) -
+                  std::clamp(bounds[i].y0, 0.f, static_cast<float>(region_.frame_height));
+        return projected[i] ? w * h : 0.f;
+    };
+    auto* candidates = linear.allocate_array<uint32_t>(objects.size());
+    size_t candidate_count = 0;
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (area(i) >= occlusion_.min_occluder_area * frame_area) {
+            candidates[candidate_count++] = static_cast<uint32_t>(i);
+        }
+    }
+    size_t occluder_count = std::min(candidate_count, static_cast<size_t>(std::max(0, occlusion_.max_occluders)));
+    std::partial_sort(candidates, candidates + occluder_count, candidates + candidate_count,
+                      [&](uint32_t a, uint32_t b) { return area(a) > area(b); });
+    // Occluders go front to back and are tested before they are drawn, so a
+    // large object hidden behind a nearer one is still culled.
+    std::sort(candidates, candidates + occluder_count,
+              [&](uint32_t a, uint32_t b) { return bounds[a].nearest_depth < bounds[b].nearest_depth; });
+    // 0 = occluded, 1 = visible, 2 = drawn as an occluder.
+    auto* state = linear.allocate_array<uint8_t>(objects.size());
+    std::copy(object_visible, object_visible + objects.size(), state);
+    for (size_t k = 0; k < occluder_count; ++k) {
+        const ModelObject& object = objects[candidates[k]];
+        if (!occlusion_buffer_.visible(bounds[candidates[k]])) {
+            state[candidates[k]] = 0;
+            continue;
+        }
+        state[candidates[k]] = 2;
+        for (size_t face = object.first_face; face < object.first_face + object.face_count; ++face) {
+            auto ids = model.face_vertex_indices(face);
+            occlusion_buffer_.render_occluder(clip * to_vec4(model.vertex(ids[0]), 1.f),
+                                              clip * to_vec4(model.vertex(ids[1]), 1.f),
+                                              clip * to_vec4(model.vertex(ids[2]), 1.f),
+                                              model.face_open_edges(face));
+        }
+    }
+    parallel_for(objects.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (state[i] == 1 && projected[i] && !occlusion_buffer_.visible(bounds[i])) {
+                state[i] = 0;
+            }
+        }
+    });
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        bool occluded = object_visible[i] && state[i] == 0;
+        stats_.objects_tested += projected[i] ? 1 : 0;
+        stats_.objects_occluded += occluded ? 1 : 0;
+        stats_.triangles_occluded += occluded ? objects[i].face_count : 0;
+        object_visible[i] = state[i] != 0;
+    }
+}
+
+void Rasterizer::tile_stage(const IShader& shader, int workers) {
+    begin_stage(RenderStage::Raster);
+    if (tile_source_) {
+        parallel_for(static_cast<size_t>(workers), 1, [&](size_t, size_t) {
+            int tile = 0;
+            while (tile_source_->claim(tile)) {
+                TRACE_SCOPE_ARG("tile", static_cast<int64_t>(tile));
+                clear_tile(tile);
+                raster_tile(tile, shader);
+                tile_source_->complete(tile);
+            }
+        });
+    } else {
+        parallel_for(static_cast<size_t>(tiles_x_) * tiles_y_, 1, [&](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; ++tile) {
+                TRACE_SCOPE_ARG("tile", static_cast<int64_t>(tile));
+                raster_tile(static_cast<int>(tile), shader);
+            }
+        });
+    }
+    end_stage(RenderStage::Raster);
+}
+
+void Rasterizer::split_tile_time(double tile_phase_ms) {
+    uint64_t tile_ns = counters_.tile_ns.load();
+    double shade_share = tile_ns > 0 ? static_cast<double>(counters_.shade_ns.load()) / tile_ns : 0.0;
+    stats_.shade_ms = tile_phase_ms * std::min(1.0, shade_share);
+    stats_.raster_ms = tile_phase_ms - stats_.shade_ms;
+}
+
+void Rasterizer::publish_counters() {
+    stats_.triangles_submitted = triangle_count_;
+    stats_.triangles_culled = counters_.triangles_culled.load();
+    stats_.triangles_bbox_clamped = counters_.triangles_bbox_clamped.load();
+    stats_.pixels_tested = counters_.pixels_tested.load();
+    stats_.depth_tests = counters_.depth_tests.load();
+    stats_.depth_passed = counters_.depth_passed.load();
+    stats_.fragments_shaded = counters_.fragments_shaded.load();
+    stats_.pixels_covered = counters_.pixels_covered.load();
+}
+
+void Rasterizer::transform_vertices(const Model& model, IShader& shader, size_t begin, size_t end) {
+    for (size_t id = begin; id < end; ++id) {
+        size_t face = visible_faces_ ? visible_faces_[id] : id;
         auto vertex_ids = model.face_vertex_indices(face);
         auto normal_ids = model.face_normal_indices(face);
+        auto& verts = triangles_[id].verts;
 
         for (int i = 0; i < 3; ++i) {
             VertexInput input{model.vertex(vertex_ids[i]), model.normal(normal_ids[i])};
-            VertexOutput output = shader.vertex(input);
-            float inv_w = output.reciprocal_w;
-            Vec3f ndc{output.clip_position.x * inv_w,
-                      output.clip_position.y * inv_w,
-                      output.clip_position.z * inv_w};
+            verts[i].payload = shader.vertex(input);
+        }
+        project_vertices(id);
+    }
+}
+
+// Screen positions and depths of triangle id from its vertex payloads, and
+// its depth key.
+void Rasterizer::project_vertices(size_t id) {
+    int width = region_.frame_width;
+    int height = region_.frame_height;
+    bool reversed = depth_format_ == DepthFormat::ReversedFloat32;
+    auto& verts = triangles_[id].verts;
+
+    for (RasterVertex& vert : verts) {
+        const VertexOutput& output = vert.payload;
+        float inv_w = output.reciprocal_w;
+        Vec3f ndc{output.clip_position.x * inv_w,
+                  output.clip_position.y * inv_w,
+                  output.clip_position.z * inv_w};
+
+        vert.screen_pos = {
+            (ndc.x + 1.f) * 0.5f * static_cast<float>(width - 1),
+            (1.f - (ndc.y + 1.f) * 0.5f) * static_cast<float>(height - 1)
+        };
+        // A reversed-Z projection already maps to [0, 1], near to far.
+        vert.depth = reversed ? ndc.z : (ndc.z + 1.f) * 0.5f;
+    }
+    if (depth_keys_) {
+        // Nearest vertex in standard depth order. A NaN depth would be
+        // skipped by std::min, so it keys the triangle first explicitly.
+        float nearest = 1.f;
+        for (const RasterVertex& vert : verts) {
+            float depth = reversed ? 1.f - vert.depth : vert.depth;
+            if (std::isnan(depth)) {
+                nearest = 0.f;
+                break;
+            }
+            nearest = std::min(nearest, depth);
+        }
+        nearest = std::max(nearest, 0.f);
+        depth_keys_[id] = static_cast<uint16_t>(nearest * 65535.f + 0.5f);
+    }
+}
+
+// Stable LSD radix sort of the triangle ids on depth_keys_, 8 bits per pass.
+// Each pass histograms and scatters kSortChunk ids per job.
+void Rasterizer::sort_draw_order() {
+    draw_order_ids_ = nullptr;
+    if (!depth_keys_) {
+        return;
+    }
+    TRACE_SCOPE("depth sort");
+    constexpr int kRadixBits = 8;
+    constexpr size_t kRadix = size_t{1} << kRadixBits;
+    LinearAllocator& linear = arena_.linear(0);
+    size_t count = triangle_count_;
+    size_t chunks = (count + kSortChunk - 1) / kSortChunk;
+    auto* offsets = linear.allocate_array<uint32_t>(chunks * kRadix);
+    uint32_t* buffers[2] = {linear.allocate_array<uint32_t>(count), linear.allocate_array<uint32_t>(count)};
+
+    const uint32_t* source = nullptr;
+    for (int shift = 0, pass = 0; shift < kDepthKeyBits; shift += kRadixBits, ++pass) {
+        uint32_t* dest = buffers[pass & 1];
+        auto id_at = [&](size_t i) { return source ? source[i] : static_cast<uint32_t>(i); };
+        parallel_for(chunks, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; ++chunk) {
+                uint32_t* histogram = offsets + chunk * kRadix;
+                std::fill(histogram, histogram + kRadix, 0u);
+                for (size_t i = chunk * kSortChunk; i < std::min(count, (chunk + 1) * kSortChunk); ++i) {
+                    ++histogram[(depth_keys_[id_at(i)] >> shift) & (kRadix - 1)];
+                }
+            }
+        });
+        // Digit-major prefix sum, so each chunk scatters its ids after every
+        // earlier chunk's ids with the same digit.
+        uint32_t total = 0;
+        for (size_t digit = 0; digit < kRadix; ++digit) {
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                uint32_t bucket = offsets[chunk * kRadix + digit];
+                offsets[chunk * kRadix + digit] = total;
+                total += bucket;
+            }
+        }
+        parallel_for(chunks, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; ++chunk) {
+                uint32_t* next = offsets + chunk * kRadix;
+                for (size_t i = chunk * kSortChunk; i < std::min(count, (chunk + 1) * kSortChunk); ++i) {
+                    uint32_t id = id_at(i);
+                    dest[next[(depth_keys_[id] >> shift) & (kRadix - 1)]++] = id;
+                }
+            }
+        });
+        source = dest;
+    }
+    draw_order_ids_ = source;
+}
 
-            verts[i].screen_pos = {
-                (ndc.x + 1.f) * 0.5f * static_cast<float>(width - 1),
-                (1.f - (ndc.y + 1.f) * 0.5f) * static_cast<float>(height - 1)
-            };
-            verts[i].depth = (ndc.z + 1.f) * 0.5f;
-            verts[i].payload = output;
+void Rasterizer::bin_triangles(size_t batch) {
+    PoolAllocator& pool = arena_.bin_pool(worker_index());
+    BinList* bins = bins_ + batch * static_cast<size_t>(tiles_x_) * tiles_y_;
+    size_t begin = batch * kBinBatch;
+    size_t end = std::min(triangle_count_, begin + kBinBatch);
+    uint64_t culled = 0;
+    uint64_t clamped = 0;
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t id = draw_order_ids_ ? draw_order_ids_[i] : static_cast<uint32_t>(i);
+#if defined(__SSE2__)
+        // Sorted ids visit triangles_ in random order.
+        if (draw_order_ids_ && i + kSortPrefetch < end) {
+            const char* ahead = reinterpret_cast<const char*>(triangles_ + draw_order_ids_[i + kSortPrefetch]);
+            for (size_t line = 0; line < sizeof(Triangle); line += 64) {
+                _mm_prefetch(ahead + line, _MM_HINT_T0);
+            }
+        }
+#endif
+        BinResult result = bin_triangle(id, bins, pool);
+        if (result != BinResult::Culled) {
+            setup_planes(triangles_[id]);
         }
+        culled += result == BinResult::Culled ? 1 : 0;
+        clamped += result == BinResult::Clamped ? 1 : 0;
+    }
+    counters_.triangles_culled.fetch_add(culled, std::memory_order_relaxed);
+    counters_.triangles_bbox_clamped.fetch_add(clamped, std::memory_order_relaxed);
+}
 
-        float min_x = std::min({verts[0].screen_pos[0], verts[1].screen_pos[0], verts[2].screen_pos[0]});
-        float max_x = std::max({verts[0].screen_pos[0], verts[1].screen_pos[0], verts[2].screen_pos[0]});
-        float min_y = std::min({verts[0].screen_pos[1], verts[1].screen_pos[1], verts[2].screen_pos[1]});
-        float max_y = std::max({verts[0].screen_pos[1], verts[1].screen_pos[1], verts[2].screen_pos[1]});
+void Rasterizer::bin_bands(size_t batch, int band_rows, size_t band_count) {
+    float frame_x1 = static_cast<float>(region_.frame_width - 1);
+    float frame_y1 = static_cast<float>(region_.frame_height - 1);
+    LinearAllocator& linear = arena_.linear(worker_index());
+    BinList* bands = band_bins_ + batch * band_count;
+    size_t begin = batch * kBinBatch;
+    size_t end = std::min(triangle_count_, begin + kBinBatch);
+    uint64_t culled = 0;
+    uint64_t clamped = 0;
 
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t id = draw_order_ids_ ? draw_order_ids_[i] : static_cast<uint32_t>(i);
+        const auto& verts = triangles_[id].verts;
+        const auto& a = verts[0].screen_pos;
+        const auto& b = verts[1].screen_pos;
+        const auto& c = verts[2].screen_pos;
+        float area = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+        float min_x = std::min({a[0], b[0], c[0]});
+        float max_x = std::max({a[0], b[0], c[0]});
+        float min_y = std::min({a[1], b[1], c[1]});
+        float max_y = std::max({a[1], b[1], c[1]});
         int x0 = static_cast<int>(std::floor(std::max(0.f, min_x)));
-        int x1 = static_cast<int>(std::ceil(std::min(static_cast<float>(width - 1), max_x)));
+        int x1 = static_cast<int>(std::ceil(std::min(frame_x1, max_x)));
         int y0 = static_cast<int>(std::floor(std::max(0.f, min_y)));
-        int y1 = static_cast<int>(std::ceil(std::min(static_cast<float>(height - 1), max_y)));
-
-        for (int y = y0; y <= y1; ++y) {
-            for (int x = x0; x <= x1; ++x) {
-                float px = static_cast<float>(x) + 0.5f;
-                float py = static_cast<float>(y) + 0.5f;
-                Vec3f bary = barycentric(verts[0].screen_pos, verts[1].screen_pos, verts[2].screen_pos, px, py);
-                if (bary.x < 0.f || bary.y < 0.f || bary.z < 0.f) {
+        int y1 = static_cast<int>(std::ceil(std::min(frame_y1, max_y)));
+        if (std::abs(area) < 1e-8f || x0 > x1 || y0 > y1) {
+            ++culled;
+            continue;
+        }
+        if (min_x < 0.f || min_y < 0.f || max_x > frame_x1 || max_y > frame_y1) {
+            ++clamped;
+        }
+        // Once per frame; the bands only bin.
+        setup_planes(triangles_[id]);
+        for (int band = y0 / band_rows; band <= y1 / band_rows; ++band) {
+            BinList& list = bands[band];
+            if (!list.tail || list.tail->count == kBinChunkCapacity) {
+                auto* chunk = linear.allocate_array<BinChunk>(1);
+                chunk->next = nullptr;
+                chunk->count = 0;
+                (list.tail ? list.tail->next : list.head) = chunk;
+                list.tail = chunk;
+            }
+            list.tail->ids[list.tail->count++] = id;
+        }
+    }
+
+    counters_.triangles_culled.fetch_add(culled, std::memory_order_relaxed);
+    counters_.triangles_bbox_clamped.fetch_add(clamped, std::memory_order_relaxed);
+}
+
+void Rasterizer::bin_band_triangles(size_t batch, size_t band, size_t band_count) {
+    PoolAllocator& pool = arena_.bin_pool(worker_index());
+    BinList* bins = bins_ + batch * static_cast<size_t>(tiles_x_) * tiles_y_;
+    for (const BinChunk* chunk = band_bins_[batch * band_count + band].head; chunk; chunk = chunk->next) {
+        for (uint32_t i = 0; i < chunk->count; ++i) {
+            bin_triangle(chunk->ids[i], bins, pool);
+        }
+    }
+}
+
+Rasterizer::BinResult Rasterizer::bin_triangle(uint32_t id, BinList* bins, PoolAllocator& pool) {
+    float clip_x0 = static_cast<float>(region_.x0);
+    float clip_y0 = static_cast<float>(region_.y0);
+    float clip_x1 = static_cast<float>(region_.x1 - 1);
+    float clip_y1 = static_cast<float>(region_.y1 - 1);
+    Triangle& tri = triangles_[id];
+    const auto& a = tri.verts[0].screen_pos;
+    const auto& b = tri.verts[1].screen_pos;
+    const auto& c = tri.verts[2].screen_pos;
+    float area = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+    if (std::abs(area) < 1e-8f) {
+        tri.x0 = tri.y0 = 0;
+        tri.x1 = tri.y1 = -1;
+        return BinResult::Culled;
+    }
+
+    float min_x = std::min({a[0], b[0], c[0]});
+    float max_x = std::max({a[0], b[0], c[0]});
+    float min_y = std::min({a[1], b[1], c[1]});
+    float max_y = std::max({a[1], b[1], c[1]});
+
+    // Bounds are clamped to the region and stored region-relative.
+    tri.x0 = static_cast<int>(std::floor(std::max(clip_x0, min_x))) - region_.x0;
+    tri.x1 = static_cast<int>(std::ceil(std::min(clip_x1, max_x))) - region_.x0;
+    tri.y0 = static_cast<int>(std::floor(std::max(clip_y0, min_y))) - region_.y0;
+    tri.y1 = static_cast<int>(std::ceil(std::min(clip_y1, max_y))) - region_.y0;
+    if (tri.x0 > tri.x1 || tri.y0 > tri.y1) {
+        return BinResult::Culled;
+    }
+
+    int tx0 = tri.x0 / kTileSize;
+    int tx1 = tri.x1 / kTileSize;
+    int ty0 = tri.y0 / kTileSize;
+    int ty1 = tri.y1 / kTileSize;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            BinList& bin = bins[static_cast<size_t>(ty) * tiles_x_ + tx];
+            if (!bin.tail || bin.tail->count == kBinChunkCapacity) {
+                auto* chunk = static_cast<BinChunk*>(pool.allocate());
+                chunk->next = nullptr;
+                chunk->count = 0;
+                (bin.tail ? bin.tail->next : bin.head) = chunk;
+                bin.tail = chunk;
+            }
+            bin.tail->ids[bin.tail->count++] = id;
+        }
+    }
+    bool clamped = min_x < clip_x0 || min_y < clip_y0 || max_x > clip_x1 || max_y > clip_y1;
+    return clamped ? BinResult::Clamped : BinResult::Binned;
+}
+
+void Rasterizer::setup_planes(Triangle& tri) {
+    const auto& verts = tri.verts;
+    const auto& a = verts[0].screen_pos;
+    const auto& b = verts[1].screen_pos;
+    const auto& c = verts[2].screen_pos;
+    float inv_area = 1.f / ((b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]));
+    // Gradients of the second and third barycentric coordinates.
+    float u_dx = (c[1] - a[1]) * inv_area;
+    float u_dy = (a[0] - c[0]) * inv_area;
+    float v_dx = (a[1] - b[1]) * inv_area;
+    float v_dy = (b[0] - a[0]) * inv_area;
+    auto plane = [&](float f0, float f1, float f2) {
+        float d1 = f1 - f0;
+        float d2 = f2 - f0;
+        return Plane{f0, d1 * u_dx + d2 * v_dx, d1 * u_dy + d2 * v_dy};
+    };
+
+    const VertexOutput& p0 = verts[0].payload;
+    const VertexOutput& p1 = verts[1].payload;
+    const VertexOutput& p2 = verts[2].payload;
+    float w0 = p0.reciprocal_w;
+    float w1 = p1.reciprocal_w;
+    float w2 = p2.reciprocal_w;
+    AttributePlanes& planes = tri.planes;
+    planes.origin = a;
+    planes.inv_w = plane(w0, w1, w2);
+    for (int i = 0; i < 3; ++i) {
+        planes.world_position[static_cast<size_t>(i)] =
+            plane(p0.world_position[i] * w0, p1.world_position[i] * w1, p2.world_position[i] * w2);
+        planes.normal[static_cast<size_t>(i)] = plane(p0.normal[i] * w0, p1.normal[i] * w1, p2.normal[i] * w2);
+    }
+}
+
+Rasterizer::TileRect Rasterizer::tile_rect(int tile) const {
+    TileRect rect;
+    rect.x0 = (tile % tiles_x_) * kTileSize;
+    rect.y0 = (tile / tiles_x_) * kTileSize;
+    rect.x1 = std::min(region_.width(), rect.x0 + kTileSize) - 1;
+    rect.y1 = std::min(region_.height(), rect.y0 + kTileSize) - 1;
+    return rect;
+}
+
+// ShadingRate values are the log2 of the block size.
+int Rasterizer::tile_rate_shift(int tile) const {
+    switch (shading_rate_.mode) {
+        case ShadingRateMode::Full: return 0;
+        case ShadingRateMode::Coarse2x2: return 1;
+        case ShadingRateMode::Coarse4x4: return 2;
+        case ShadingRateMode::Image: return static_cast<int>(shading_rate_.tile_rates[static_cast<size_t>(tile)]);
+        case ShadingRateMode::Adaptive: break;
+    }
+    float spread_sum = 0.f;
+    float depth_sum = 0.f;
+    float depth_squares = 0.f;
+    size_t count = 0;
+    size_t tile_count = static_cast<size_t>(tiles_x_) * tiles_y_;
+    for (size_t batch = 0; batch < batch_count_; ++batch) {
+        for (const BinChunk* chunk = bins_[batch * tile_count + tile].head; chunk; chunk = chunk->next) {
+            for (uint32_t i = 0; i < chunk->count; ++i) {
+                Vec3f normal_sum{0.f, 0.f, 0.f};
+                for (const RasterVertex& vert : triangles_[chunk->ids[i]].verts) {
+                    normal_sum += normalize(vert.payload.normal);
+                    float w = vert.payload.clip_position.w;
+                    depth_sum += w;
+                    depth_squares += w * w;
+                }
+                Vec3f mean_normal = normal_sum * (1.f / 3.f);
+                spread_sum += 1.f - dot(mean_normal, mean_normal);
+                ++count;
+            }
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    float normal_spread = spread_sum / static_cast<float>(count);
+    float inv_count = 1.f / static_cast<float>(3 * count);
+    float mean_depth = depth_sum * inv_count;
+    float depth_variance = std::max(0.f, depth_squares * inv_count - mean_depth * mean_depth);
+    if (mean_depth <= 0.f || std::sqrt(depth_variance) > shading_rate_.max_depth_spread * mean_depth) {
+        return 0;
+    }
+    if (normal_spread < shading_rate_.normal_spread_4x4) {
+        return 2;
+    }
+    return normal_spread < shading_rate_.normal_spread_2x2 ? 1 : 0;
+}
+
+void Rasterizer::clear_tile(int tile) {
+    TileRect rect = tile_rect(tile);
+    if (layout_ == FramebufferLayout::Linear && samples_ == 1) {
+        int width = color_buffer_.width();
+        size_t span = static_cast<size_t>(rect.x1 - rect.x0 + 1);
+        color_buffer_.fill_rect(rect.x0, rect.y0, rect.x1 + 1, rect.y1 + 1, clear_color_);
+        for (int y = rect.y0; y <= rect.y1; ++y) {
+            size_t offset = static_cast<size_t>(y) * width + rect.x0;
+            fill_depth(offset, span);
+        }
+        tile_state_[static_cast<size_t>(tile)] = kTileResolved;
+        return;
+    }
+    uint8_t clear[3];
+    Image::pack_rgb(clear_color_, clear);
+    uint8_t* colors = samples_ > 1 ? sample_color_.data() : tiled_color_.data();
+    auto fill_run = [&](size_t offset, size_t count) {
+        for (int sample = 0; sample < samples_; ++sample) {
+            size_t start = static_cast<size_t>(sample) * sample_plane_ + offset;
+            fill_depth(start, count);
+            uint8_t* color = colors + start * 3;
+            for (size_t i = 0; i < count; ++i) {
+                std::memcpy(color + i * 3, clear, 3);
+            }
+        }
+    };
+    if (layout_ == FramebufferLayout::Linear) {
+        size_t span = static_cast<size_t>(rect.x1 - rect.x0 + 1);
+        for (int y = rect.y0; y <= rect.y1; ++y) {
+            fill_run(static_cast<size_t>(y) * color_buffer_.width() + rect.x0, span);
+        }
+    } else {
+        // Tiles are block aligned, so each block row of a tile is one contiguous run.
+        size_t block_pixels = kBlockSize * kBlockSize;
+        int bx0 = rect.x0 / kBlockSize;
+        size_t run = static_cast<size_t>(rect.x1 / kBlockSize - bx0 + 1) * block_pixels;
+        for (int by = rect.y0 / kBlockSize; by <= rect.y1 / kBlockSize; ++by) {
+            fill_run((static_cast<size_t>(by) * blocks_x_ + bx0) * block_pixels, run);
+        }
+    }
+    tile_state_[static_cast<size_t>(tile)] = kTileDirty;
+}
+
+void Rasterizer::resolve_clears() const {
+    size_t tile_count = static_cast<size_t>(tiles_x_) * tiles_y_;
+    for (size_t tile = 0; tile < tile_count; ++tile) {
+        if (tile_state_[tile] == kTileResolved) {
+            continue;
+        }
+        TileRect rect = tile_rect(static_cast<int>(tile));
+        if (tile_state_[tile] == kTileCleared) {
+            color_buffer_.fill_rect(rect.x0, rect.y0, rect.x1 + 1, rect.y1 + 1, clear_color_);
+        } else {
+            detile(rect);
+        }
+        tile_state_[tile] = kTileResolved;
+    }
+}
+
+void Rasterizer::detile(const TileRect& rect) const {
+    int width = color_buffer_.width();
+    // Longest run of pixels that is contiguous in the working layout.
+    int span = layout_ == FramebufferLayout::Linear ? kTileSize
+               : layout_ == FramebufferLayout::Tiled ? kBlockSize
+                                                     : 1;
+    for (int y = rect.y0; y <= rect.y1; ++y) {
+        uint8_t* out = color_buffer_.data() + static_cast<size_t>(y) * width * 3;
+        for (int x = rect.x0; x <= rect.x1; x += span) {
+            size_t bytes = static_cast<size_t>(std::min(span, rect.x1 + 1 - x)) * 3;
+            size_t offset = working_offset(x, y) * 3;
+            if (samples_ == 1) {
+                std::memcpy(out + static_cast<size_t>(x) * 3, tiled_color_.data() + offset, bytes);
+                continue;
+            }
+            const uint8_t* samples = sample_color_.data() + offset;
+            size_t plane = sample_plane_ * 3;
+            average_samples(samples, samples + plane, samples + 2 * plane, samples + 3 * plane,
+                            out + static_cast<size_t>(x) * 3, bytes);
+        }
+    }
+}
+
+size_t Rasterizer::working_offset(int x, int y) const {
+    switch (layout_) {
+        case FramebufferLayout::Tiled: return pixel_offset<FramebufferLayout::Tiled>(x, y);
+        case FramebufferLayout::Morton: return pixel_offset<FramebufferLayout::Morton>(x, y);
+        default: return pixel_offset<FramebufferLayout::Linear>(x, y);
+    }
+}
+
+void Rasterizer::raster_tile(int tile, const IShader& shader) {
+    switch (depth_format_) {
+        case DepthFormat::ReversedFloat32: raster_tile_as<DepthFormat::ReversedFloat32>(tile, shader); break;
+        case DepthFormat::Unorm24: raster_tile_as<DepthFormat::Unorm24>(tile, shader); break;
+        case DepthFormat::Unorm16: raster_tile_as<DepthFormat::Unorm16>(tile, shader); break;
+        default: raster_tile_as<DepthFormat::Float32>(tile, shader); break;
+    }
+}
+
+template <DepthFormat kFormat>
+void Rasterizer::raster_tile_as(int tile, const IShader& shader) {
+    switch (layout_) {
+        case FramebufferLayout::Tiled: raster_tile_in<FramebufferLayout::Tiled, kFormat>(tile, shader); break;
+        case FramebufferLayout::Morton: raster_tile_in<FramebufferLayout::Morton, kFormat>(tile, shader); break;
+        default: raster_tile_in<FramebufferLayout::Linear, kFormat>(tile, shader); break;
+    }
+}
+
+template <FramebufferLayout kLayout, DepthFormat kFormat>
+void Rasterizer::raster_tile_in(int tile, const IShader& shader) {
+    auto tile_start = StatsClock::now();
+    TileRect rect = tile_rect(tile);
+
+    TileCounters counters;
+    ShadeQueue& queue = shade_queues_[static_cast<size_t>(worker_index())];
+    bool touched = false;
+    bool fresh = false;
+    int rate_shift = 0;
+    bool prepass = depth_prepass_ && samples_ == 1 && debug_mode_ != DebugMode::DepthComplexity;
+    size_t tile_count = static_cast<size_t>(tiles_x_) * tiles_y_;
+    for (size_t batch = 0; batch < batch_count_; ++batch) {
+        for (const BinChunk* chunk = bins_[batch * tile_count + tile].head; chunk; chunk = chunk->next) {
+            if (!touched && tile_state_[static_cast<size_t>(tile)] == kTileCleared) {
+                clear_tile(tile);
+                fresh = true;
+            }
+            if (!touched && samples_ == 1 && debug_mode_ != DebugMode::DepthComplexity) {
+                rate_shift = tile_rate_shift(tile);
+            }
+            touched = true;
+            for (uint32_t i = 0; i < chunk->count; ++i) {
+                const Triangle& tri = triangles_[chunk->ids[i]];
+                const IShader& tri_shader = draw_shaders_ ? draw_shaders_[tri.draw] : shader;
+                if (prepass) {
+                    if (fresh) {
+                        raster_depth<true, kLayout, kFormat>(tri, rect, counters);
+                        fresh = false;
+                    } else {
+                        raster_depth<false, kLayout, kFormat>(tri, rect, counters);
+                    }
+                } else if (samples_ > 1) {
+                    if (debug_mode_ == DebugMode::DepthComplexity) {
+                        raster_triangle_msaa<true, false, kLayout, kFormat>(tri, rect, tri_shader, counters, queue);
+                    } else if (fresh) {
+                        raster_triangle_msaa<false, true, kLayout, kFormat>(tri, rect, tri_shader, counters, queue);
+                        fresh = false;
+                    } else {
+                        raster_triangle_msaa<false, false, kLayout, kFormat>(tri, rect, tri_shader, counters, queue);
+                    }
+                } else if (debug_mode_ == DebugMode::DepthComplexity) {
+                    raster_triangle<true, false, false, kLayout, kFormat>(tri, rect, tri_shader, 0, counters, queue);
+                } else if (fresh) {
+                    // Nothing has been drawn yet, so every depth test is against the clear value.
+                    raster_triangle<false, true, false, kLayout, kFormat>(tri, rect, tri_shader, rate_shift, counters,
+                                                                          queue);
+                    fresh = false;
+                } else {
+                    raster_triangle<false, false, false, kLayout, kFormat>(tri, rect, tri_shader, rate_shift, counters,
+                                                                           queue);
+                }
+            }
+        }
+    }
+    if (!touched) {
+        return;
+    }
+    if (prepass) {
+        std::array<uint64_t, kTileSize> shaded_rows{};
+        for (size_t batch = 0; batch < batch_count_; ++batch) {
+            for (const BinChunk* chunk = bins_[batch * tile_count + tile].head; chunk; chunk = chunk->next) {
+                for (uint32_t i = 0; i < chunk->count; ++i) {
+                    const Triangle& tri = triangles_[chunk->ids[i]];
+                    const IShader& tri_shader = draw_shaders_ ? draw_shaders_[tri.draw] : shader;
+                    raster_triangle<false, false, true, kLayout, kFormat>(tri, rect, tri_shader, rate_shift, counters,
+                                                                          queue, shaded_rows.data());
+                }
+            }
+        }
+    }
+    flush_shading<kLayout>(queue, counters);
+    if (kLayout != FramebufferLayout::Linear || samples_ > 1) {
+        tile_state_[static_cast<size_t>(tile)] = kTileDirty;
+    }
+
+    counters_.pixels_tested.fetch_add(counters.pixels_tested, std::memory_order_relaxed);
+    counters_.depth_tests.fetch_add(counters.depth_tests, std::memory_order_relaxed);
+    counters_.depth_passed.fetch_add(counters.depth_passed, std::memory_order_relaxed);
+    counters_.fragments_shaded.fetch_add(counters.fragments_shaded, std::memory_order_relaxed);
+    counters_.pixels_covered.fetch_add(counters.pixels_covered, std::memory_order_relaxed);
+    counters_.shade_ns.fetch_add(counters.shade_ns, std::memory_order_relaxed);
+    counters_.tile_ns.fetch_add(elapsed_ns(tile_start, StatsClock::now()), std::memory_order_relaxed);
+}
+
+// Coverage and interpolated depth at the center of region pixel (x, y). Both
+// the depth-only and the shading loops use it, so they agree bit for bit.
+inline bool Rasterizer::pixel_depth(const Triangle& tri, int x, int y, float& depth) const {
+    const auto& verts = tri.verts;
+    Vec3f bary = barycentric(verts[0].screen_pos, verts[1].screen_pos, verts[2].screen_pos,
+                             static_cast<float>(x + region_.x0) + 0.5f,
+                             static_cast<float>(y + region_.y0) + 0.5f);
+    if (bary.x < 0.f || bary.y < 0.f || bary.z < 0.f) {
+        return false;
+    }
+    depth = bary.x * verts[0].depth + bary.y * verts[1].depth + bary.z * verts[2].depth;
+    return true;
+}
+
+template <bool kFreshTile, FramebufferLayout kLayout, DepthFormat kFormat>
+void Rasterizer::raster_depth(const Triangle& tri, const TileRect& rect, TileCounters& counters) {
+    using Depth = DepthTraits<kFormat>;
+    int x0 = std::max(tri.x0, rect.x0);
+    int x1 = std::min(tri.x1, rect.x1);
+    int y0 = std::max(tri.y0, rect.y0);
+    int y1 = std::min(tri.y1, rect.y1);
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    counters.pixels_tested += static_cast<uint64_t>(x1 - x0 + 1) * (y1 - y0 + 1);
+    uint64_t tests = 0;
+    uint64_t passed = 0;
+    uint64_t covered = 0;
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            float depth;
+            if (!pixel_depth(tri, x, y, depth)) {
+                continue;
+            }
+            ++tests;
+            size_t index = pixel_offset<kLayout>(x, y);
+            auto encoded = Depth::encode(depth);
+            auto stored = kFreshTile ? Depth::clear() : Depth::load(depth_, index);
+            if (Depth::passes(encoded, stored)) {
+                Depth::store(depth_, index, encoded);
+                ++passed;
+                covered += stored == Depth::clear() ? 1 : 0;
+            }
+        }
+    }
+    counters.depth_tests += tests;
+    counters.depth_passed += passed;
+    counters.pixels_covered += covered;
+}
+
+template <bool kCountComplexity, bool kFreshTile, bool kDepthEqual, FramebufferLayout kLayout, DepthFormat kFormat>
+void Rasterizer::raster_triangle(const Triangle& tri,
+                                 const TileRect& rect,
+                                 const IShader& shader,
+                                 int rate_shift,
+                                 TileCounters& counters,
+                                 ShadeQueue& queue,
+                                 uint64_t* shaded_rows) {
+    using Depth = DepthTraits<kFormat>;
+    int width = color_buffer_.width();
+    int x0 = std::max(tri.x0, rect.x0);
+    int x1 = std::min(tri.x1, rect.x1);
+    int y0 = std::max(tri.y0, rect.y0);
+    int y1 = std::min(tri.y1, rect.y1);
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    if constexpr (!kDepthEqual) {
+        counters.pixels_tested += static_cast<uint64_t>(x1 - x0 + 1) * (y1 - y0 + 1);
+    }
+
+    uint32_t* tested = nullptr;
+    uint32_t* passed = nullptr;
+    uint32_t* shaded = nullptr;
+    if constexpr (kCountComplexity) {
+        tested = complexity_.data(ComplexityChannel::Tested);
+        passed = complexity_.data(ComplexityChannel::Passed);
+        shaded = complexity_.data(ComplexityChannel::Shaded);
+    }
+
+    // Coverage and depth first; the survivors are queued and shaded later in
+    // submission order, which leaves the same color as shading inline.
+    // Pixels are walked in quads of 2x2 shading blocks aligned to the
+    // quad's footprint in frame coordinates, so bands and regions coarsen the
+    // same blocks as a full frame. A quad straddling a tile edge is walked by
+    // both tiles, each keeping its own pixels.
+    const int footprint = 2 << rate_shift;
+    std::vector<PendingQuad>& pending = queue.quads;
+    const size_t first_quad = pending.size();
+    uint64_t fragments = 0;
+    uint64_t covered = 0;
+    uint64_t invocations = 0;
+    for (int qy = ((y0 + region_.y0) & -footprint) - region_.y0; qy <= y1; qy += footprint) {
+        for (int qx = ((x0 + region_.x0) & -footprint) - region_.x0; qx <= x1; qx += footprint) {
+            PendingQuad quad{qx, qy};
+            for (int bit = 0; bit < footprint * footprint; ++bit) {
+                int px = bit & (footprint - 1);
+                int py = bit >> (rate_shift + 1);
+                int x = qx + px;
+                int y = qy + py;
+                if (x > x1 || y > y1 || x < x0 || y < y0) {
+                    continue;
+                }
+                uint64_t column = uint64_t{1} << (x - rect.x0);
+                if constexpr (kDepthEqual) {
+                    // Pixels already shaded need no coverage test.
+                    if (shaded_rows[y - rect.y0] & column) {
+                        continue;
+                    }
+                }
+                float depth;
+                if (!pixel_depth(tri, x, y, depth)) {
+                    continue;
+                }
+                size_t index = pixel_offset<kLayout>(x, y);
+                if constexpr (kDepthEqual) {
+                    if (Depth::encode(depth) != Depth::load(depth_, index)) {
+                        continue;
+                    }
+                    shaded_rows[y - rect.y0] |= column;
+                    quad.coverage |= uint64_t{1} << bit;
+                    quad.mask |= 1u << ((px >> rate_shift) | (py >> rate_shift) << 1);
+                    continue;
+                }
+                ++counters.depth_tests;
+                size_t linear = static_cast<size_t>(y) * width + x;
+                if constexpr (kCountComplexity) {
+                    ++tested[linear];
+                }
+                auto encoded = Depth::encode(depth);
+                auto stored = kFreshTile ? Depth::clear() : Depth::load(depth_, index);
+                if (Depth::passes(encoded, stored)) {
+                    Depth::store(depth_, index, encoded);
+                    if constexpr (kCountComplexity) {
+                        ++passed[linear];
+                        ++shaded[linear];
+                    }
+                    quad.coverage |= uint64_t{1} << bit;
+                    quad.mask |= 1u << ((px >> rate_shift) | (py >> rate_shift) << 1);
+                    ++fragments;
+                    covered += stored == Depth::clear() ? 1 : 0;
+                }
+            }
+            if (quad.mask) {
+                invocations += static_cast<uint64_t>(std::popcount(quad.mask));
+                pending.push_back(quad);
+            }
+        }
+    }
+    if (pending.size() == first_quad) {
+        return;
+    }
+    if constexpr (!kDepthEqual) {
+        counters.depth_passed += fragments;
+        counters.pixels_covered += covered;
+    }
+    counters.fragments_shaded += invocations;
+    if constexpr (kCountComplexity) {
+        pending.resize(first_quad);
+        return;
+    }
+    queue_run<kLayout>(tri, shader, rate_shift, queue, counters);
+}
+
+template <FramebufferLayout kLayout>
+void Rasterizer::queue_run(const Triangle& tri,
+                           const IShader& shader,
+                           int rate_shift,
+                           ShadeQueue& queue,
+                           TileCounters& counters) {
+    queue.runs.push_back({&tri, &shader, rate_shift, queue.quads.size()});
+    if (queue.quads.size() >= kShadeBatchQuads) {
+        flush_shading<kLayout>(queue, counters);
+    }
+}
+
+template <FramebufferLayout kLayout>
+void Rasterizer::flush_shading(ShadeQueue& queue, TileCounters& counters) {
+    if (queue.runs.empty()) {
+        return;
+    }
+    auto shade_start = StatsClock::now();
+    size_t begin = 0;
+    for (const ShadeQueue::Run& run : queue.runs) {
+        shade_quads<kLayout>(*run.tri, queue.quads.data() + begin, run.end - begin, *run.shader, run.rate_shift);
+        begin = run.end;
+    }
+    counters.shade_ns += elapsed_ns(shade_start, StatsClock::now());
+    queue.quads.clear();
+    queue.runs.clear();
+}
+
+template <FramebufferLayout kLayout>
+void Rasterizer::shade_quads(const Triangle& tri,
+                             const PendingQuad* quads,
+                             size_t count,
+                             const IShader& shader,
+                             int rate_shift) {
+    static constexpr std::array<float, FragmentQuad::kLanes> kLaneX = {0.f, 1.f, 0.f, 1.f};
+    static constexpr std::array<float, FragmentQuad::kLanes> kLaneY = {0.f, 0.f, 1.f, 1.f};
+    const AttributePlanes& planes = tri.planes;
+    bool multisampled = samples_ > 1;
+    uint8_t* color_out = multisampled ? sample_color_.data() : color_data();
+    const int footprint = 2 << rate_shift;
+    // Coarse lanes are shaded at the center of their block.
+    const float block = static_cast<float>(1 << rate_shift);
+    const float center = (block - 1.f) * 0.5f;
+    FragmentQuad fragment;
+    ColorQuad colors;
+    for (size_t i = 0; i < count; ++i) {
+        const PendingQuad& quad = quads[i];
+        Float4 dx = Float4(static_cast<float>(quad.x + region_.x0) + 0.5f - planes.origin[0] + center) +
+                    Float4::load(kLaneX) * block + Float4::load(quad.offset_x);
+        Float4 dy = Float4(static_cast<float>(quad.y + region_.y0) + 0.5f - planes.origin[1] + center) +
+                    Float4::load(kLaneY) * block + Float4::load(quad.offset_y);
+        Float4 w = Float4(1.f) / planes.inv_w.at(dx, dy);
+        (planes.world_position[0].at(dx, dy) * w).store(fragment.world_position.x);
+        (planes.world_position[1].at(dx, dy) * w).store(fragment.world_position.y);
+        (planes.world_position[2].at(dx, dy) * w).store(fragment.world_position.z);
+        (planes.normal[0].at(dx, dy) * w).store(fragment.normal.x);
+        (planes.normal[1].at(dx, dy) * w).store(fragment.normal.y);
+        (planes.normal[2].at(dx, dy) * w).store(fragment.normal.z);
+        fragment.mask = quad.mask;
+        shader.fragment_quad(fragment, colors);
+
+        if (!multisampled) {
+            uint8_t rgb[FragmentQuad::kLanes][3];
+            for (int lane = 0; lane < FragmentQuad::kLanes; ++lane) {
+                if (quad.mask & (1u << lane)) {
+                    Image::pack_rgb({colors.r[lane], colors.g[lane], colors.b[lane]}, rgb[lane]);
+                }
+            }
+            for (uint64_t bits = quad.coverage; bits; bits &= bits - 1) {
+                int bit = std::countr_zero(bits);
+                int px = bit & (footprint - 1);
+                int py = bit >> (rate_shift + 1);
+                int lane = (px >> rate_shift) | (py >> rate_shift) << 1;
+                std::memcpy(color_out + pixel_offset<kLayout>(quad.x + px, quad.y + py) * 3, rgb[lane], 3);
+            }
+            continue;
+        }
+        for (int lane = 0; lane < FragmentQuad::kLanes; ++lane) {
+            if (!(quad.mask & (1u << lane))) {
+                continue;
+            }
+            size_t index = pixel_offset<kLayout>(quad.x + (lane & 1), quad.y + (lane >> 1));
+            uint8_t rgb[3];
+            Image::pack_rgb({colors.r[lane], colors.g[lane], colors.b[lane]}, rgb);
+            for (int sample = 0; sample < kMsaaSamples; ++sample) {
+                if (quad.sample_mask & (1u << (lane * kMsaaSamples + sample))) {
+                    std::memcpy(color_out + (static_cast<size_t>(sample) * sample_plane_ + index) * 3, rgb, 3);
+                }
+            }
+        }
+    }
+}
+
+template <bool kCountComplexity, bool kFreshTile, FramebufferLayout kLayout, DepthFormat kFormat>
+void Rasterizer::raster_triangle_msaa(const Triangle& tri,
+                                      const TileRect& rect,
+                                      const IShader& shader,
+                                      TileCounters& counters,
+                                      ShadeQueue& queue) {
+    using Depth = DepthTraits<kFormat>;
+    int width = color_buffer_.width();
+    const auto& verts = tri.verts;
+    int x0 = std::max(tri.x0, rect.x0);
+    int x1 = std::min(tri.x1, rect.x1);
+    int y0 = std::max(tri.y0, rect.y0);
+    int y1 = std::min(tri.y1, rect.y1);
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    counters.pixels_tested += static_cast<uint64_t>(x1 - x0 + 1) * (y1 - y0 + 1);
+
+    uint32_t* tested = nullptr;
+    uint32_t* passed = nullptr;
+    uint32_t* shaded = nullptr;
+    if constexpr (kCountComplexity) {
+        tested = complexity_.data(ComplexityChannel::Tested);
+        passed = complexity_.data(ComplexityChannel::Passed);
+        shaded = complexity_.data(ComplexityChannel::Shaded);
+    }
+
+    // Barycentrics are affine in screen space, so each sample is the pixel
+    // center value plus a per-triangle constant.
+    const auto& a = verts[0].screen_pos;
+    const auto& b = verts[1].screen_pos;
+    const auto& c = verts[2].screen_pos;
+    float inv_area = 1.f / ((b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]));
+    float u_dx = (c[1] - a[1]) * inv_area;
+    float u_dy = (a[0] - c[0]) * inv_area;
+    float v_dx = (a[1] - b[1]) * inv_area;
+    float v_dy = (b[0] - a[0]) * inv_area;
+    float sample_u[kMsaaSamples];
+    float sample_v[kMsaaSamples];
+    for (int sample = 0; sample < kMsaaSamples; ++sample) {
+        sample_u[sample] = kSampleOffsets[sample][0] * u_dx + kSampleOffsets[sample][1] * u_dy;
+        sample_v[sample] = kSampleOffsets[sample][0] * v_dx + kSampleOffsets[sample][1] * v_dy;
+    }
+    float z0 = verts[0].depth;
+    float dz1 = verts[1].depth - z0;
+    float dz2 = verts[2].depth - z0;
+
+    std::vector<PendingQuad>& pending = queue.quads;
+    const size_t first_quad = pending.size();
+    uint64_t samples_passed = 0;
+    uint64_t fragments = 0;
+    uint64_t covered = 0;
+    for (int qy = y0 & ~1; qy <= y1; qy += 2) {
+        for (int qx = x0 & ~1; qx <= x1; qx += 2) {
+            PendingQuad quad{qx, qy};
+            for (int lane = 0; lane < FragmentQuad::kLanes; ++lane) {
+                int x = qx + (lane & 1);
+                int y = qy + (lane >> 1);
+                float px = static_cast<float>(x + region_.x0) + 0.5f - a[0];
+                float py = static_cast<float>(y + region_.y0) + 0.5f - a[1];
+                float u = px * u_dx + py * u_dy;
+                float v = px * v_dx + py * v_dy;
+                uint32_t mask = 0;
+                // Passing samples that held the clear value.
+                uint32_t cleared = 0;
+                int first = -1;
+                size_t index = 0;
+                if (x >= x0 && x <= x1 && y >= y0 && y <= y1) {
+                    index = pixel_offset<kLayout>(x, y);
+                    for (int sample = 0; sample < kMsaaSamples; ++sample) {
+                        float su = u + sample_u[sample];
+                        float sv = v + sample_v[sample];
+                        if (su < 0.f || sv < 0.f || su + sv > 1.f) {
+                            continue;
+                        }
+                        ++counters.depth_tests;
+                        first = first < 0 ? sample : first;
+                        size_t slot = static_cast<size_t>(sample) * sample_plane_ + index;
+                        auto encoded = Depth::encode(z0 + su * dz1 + sv * dz2);
+                        auto stored = kFreshTile ? Depth::clear() : Depth::load(depth_, slot);
+                        if (Depth::passes(encoded, stored)) {
+                            Depth::store(depth_, slot, encoded);
+                            mask |= 1u << sample;
+                            cleared |= stored == Depth::clear() ? 1u << sample : 0u;
+                            ++samples_passed;
+                        }
+                    }
+                }
+                // Shade at the pixel center when it is inside the triangle and
+                // otherwise at the first covered sample, so attributes are never
+                // extrapolated past the edge.
+                if (first < 0) {
                     continue;
                 }
-                float depth = bary.x * verts[0].depth +
-                              bary.y * verts[1].depth +
-                              bary.z * verts[2].depth;
-                size_t index = static_cast<size_t>(y) * width + x;
-                if (depth < depth_buffer_[index]) {
-                    Vec3f color = shader.fragment(bary, {verts[0].payload, verts[1].payload, verts[2].payload});
-                    color_buffer_.set_pixel(x, y, color);
-                    depth_buffer_[index] = depth;
+                if (u < 0.f || v < 0.f || u + v > 1.f) {
+                    quad.offset_x[static_cast<size_t>(lane)] = kSampleOffsets[first][0];
+                    quad.offset_y[static_cast<size_t>(lane)] = kSampleOffsets[first][1];
+                }
+                size_t linear = static_cast<size_t>(y) * width + x;
+                if constexpr (kCountComplexity) {
+                    ++tested[linear];
                 }
+                if (!mask) {
+                    continue;
+                }
+                if constexpr (kCountComplexity) {
+                    ++passed[linear];
+                    ++shaded[linear];
+                }
+                // The pixel is newly covered when every sample was clear before.
+                if (cleared == mask) {
+                    bool fresh_pixel = true;
+                    if constexpr (!kFreshTile) {
+                        for (int sample = 0; sample < kMsaaSamples && fresh_pixel; ++sample) {
+                            size_t slot = static_cast<size_t>(sample) * sample_plane_ + index;
+                            fresh_pixel = (mask & (1u << sample)) || Depth::load(depth_, slot) == Depth::clear();
+                        }
+                    }
+                    covered += fresh_pixel ? 1 : 0;
+                }
+                quad.mask |= 1u << lane;
+                quad.sample_mask |= mask << (lane * kMsaaSamples);
+                ++fragments;
+            }
+            if (quad.mask) {
+                pending.push_back(quad);
             }
         }
     }
+    if (pending.size() == first_quad) {
+        return;
+    }
+    counters.depth_passed += samples_passed;
+    counters.fragments_shaded += fragments;
+    counters.pixels_covered += covered;
+    if constexpr (kCountComplexity) {
+        pending.resize(first_quad);
+        return;
+    }
+    queue_run<kLayout>(tri, shader, 0, queue, counters);
 }
 
 bool Rasterizer::write_png(const std::string& path) const {
-    return color_buffer_.write_png(path);
+    auto start = StatsClock::now();
+    resolve_clears();
+    bool ok = color_buffer_.write_png(path);
+    stats_.encode_ms = elapsed_ms(start, StatsClock::now());
+    return ok;
 }
@@ -0,0 +1,37 @@
+#include "render_region.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+std::vector<RenderRegion> split_frame(int frame_width, int frame_height, int columns, int rows) {
+    columns = std::max(1, std::min(columns, frame_width));
+    rows = std::max(1, std::min(rows, frame_height));
+    std::vector<RenderRegion> regions;
+    regions.reserve(static_cast<size_t>(columns) * rows);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            RenderRegion region;
+            region.frame_width = frame_width;
+            region.frame_height = frame_height;
+            region.x0 = frame_width * column / columns;
+            region.x1 = frame_width * (column + 1) / columns;
+            region.y0 = frame_height * row / rows;
+            region.y1 = frame_height * (row + 1) / rows;
+            regions.push_back(region);
+        }
+    }
+    return regions;
+}
+
+Image assemble_regions(int frame_width, int frame_height, const std::vector<RegionImage>& parts) {
+    Image frame(frame_width, frame_height);
+    for (const auto& part : parts) {
+        const RenderRegion& region = part.region;
+        if (region.frame_width != frame_width || region.frame_height != frame_height ||
+            part.image.width() != region.width() || part.image.height() != region.height()) {
+            throw std::runtime_error("Region does not match the assembled frame");
+        }
+        frame.blit(part.image, region.x0, region.y0);
+    }
+    return frame;
+}
@@ -0,0 +1,66 @@
+#include "render_stats.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+void RenderStats::print(std::ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "clear      " << clear_ms << " ms\n"
+        << "vertex     " << vertex_ms << " ms\n"
+        << "setup      " << setup_ms << " ms\n"
+        << "raster     " << raster_ms << " ms\n"
+        << "shade      " << shade_ms << " ms\n"
+        << "encode     " << encode_ms << " ms\n"
+        << "total      " << total_ms << " ms\n";
+    out << "triangles  " << triangles_submitted << " submitted, "
+        << triangles_culled << " culled, "
+        << triangles_bbox_clamped << " bbox clamped\n"
+        << "pixels     " << pixels_tested << " tested, "
+        << depth_tests << " depth tests, "
+        << depth_passed << " depth passes\n"
+        << "fragments  " << fragments_shaded << " shaded, "
+        << pixels_covered << " pixels covered, overdraw "
+        << std::setprecision(2) << overdraw() << "\n"
+        << "occlusion  " << objects_occluded << " of " << objects_tested << " objects hidden, "
+        << triangles_occluded << " triangles skipped\n"
+        << "clusters   " << objects_outside << " objects outside, " << clusters_outside << " outside, " << clusters_back_facing << " back-facing of "
+        << clusters_tested << ", " << triangles_cluster_culled << " triangles skipped\n"
+        << "instances  " << instances_drawn << " drawn, " << instances_outside << " outside, "
+        << scene_passes << " passes\n";
+    out.flags(flags);
+}
+
+std::string RenderStats::to_json() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"clear_ms\":" << clear_ms
+        << ",\"vertex_ms\":" << vertex_ms
+        << ",\"setup_ms\":" << setup_ms
+        << ",\"raster_ms\":" << raster_ms
+        << ",\"shade_ms\":" << shade_ms
+        << ",\"encode_ms\":" << encode_ms
+        << ",\"total_ms\":" << total_ms
+        << ",\"triangles_submitted\":" << triangles_submitted
+        << ",\"triangles_culled\":" << triangles_culled
+        << ",\"triangles_bbox_clamped\":" << triangles_bbox_clamped
+        << ",\"pixels_tested\":" << pixels_tested
+        << ",\"depth_tests\":" << depth_tests
+        << ",\"depth_passed\":" << depth_passed
+        << ",\"fragments_shaded\":" << fragments_shaded
+        << ",\"pixels_covered\":" << pixels_covered
+        << ",\"overdraw\":" << overdraw()
+        << ",\"objects_tested\":" << objects_tested
+        << ",\"objects_occluded\":" << objects_occluded
+        << ",\"triangles_occluded\":" << triangles_occluded
+        << ",\"objects_outside\":" << objects_outside
+        << ",\"clusters_tested\":" << clusters_tested
+        << ",\"clusters_outside\":" << clusters_outside
+        << ",\"clusters_back_facing\":" << clusters_back_facing
+        << ",\"triangles_cluster_culled\":" << triangles_cluster_culled
+        << ",\"instances_drawn\":" << instances_drawn
+        << ",\"instances_outside\":" << instances_outside
+        << ",\"scene_passes\":" << scene_passes
+        << "}";
+    return out.str();
+}
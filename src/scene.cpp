@@ -0,0 +1,22 @@
+#include "scene.hpp"
+
+DrawItem& Scene::add(const Model& model, std::vector<Mat4f> instances, const Material& material) {
+    draws_.push_back({&model, std::move(instances), material});
+    return draws_.back();
+}
+
+size_t Scene::instance_count() const {
+    size_t count = 0;
+    for (const DrawItem& draw : draws_) {
+        count += draw.instances.size();
+    }
+    return count;
+}
+
+size_t Scene::triangle_count() const {
+    size_t count = 0;
+    for (const DrawItem& draw : draws_) {
+        count += draw.instances.size() * draw.model->face_count();
+    }
+    return count;
+}
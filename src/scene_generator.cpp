@@ -0,0 +1,279 @@
+#include "scene_generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+class Random {
+public:
+    explicit Random(uint32_t seed) : state_(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    float next() {
+        state_ += 0x9E3779B97F4A7C15ull;
+        uint64_t z = state_;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return static_cast<float>(z >> 40) / static_cast<float>(1ull << 24);
+    }
+
+    float range(float lo, float hi) { return lo + (hi - lo) * next(); }
+
+private:
+    uint64_t state_;
+};
+
+Model::Face make_face(int a, int b, int c) {
+    Model::Face face;
+    face.vertex_ids = {a, b, c};
+    face.normal_ids = {-1, -1, -1};
+    return face;
+}
+
+void add_grid(std::vector<Vec3f>& vertices,
+              std::vector<Model::Face>& faces,
+              int grid,
+              float z) {
+    int base = static_cast<int>(vertices.size());
+    for (int j = 0; j <= grid; ++j) {
+        for (int i = 0; i <= grid; ++i) {
+            float x = -1.f + 2.f * static_cast<float>(i) / static_cast<float>(grid);
+            float y = -1.f + 2.f * static_cast<float>(j) / static_cast<float>(grid);
+            vertices.push_back({x, y, z});
+        }
+    }
+    for (int j = 0; j < grid; ++j) {
+        for (int i = 0; i < grid; ++i) {
+            int v00 = base + j * (grid + 1) + i;
+            int v10 = v00 + 1;
+            int v01 = v00 + grid + 1;
+            int v11 = v01 + 1;
+            faces.push_back(make_face(v00, v10, v11));
+            faces.push_back(make_face(v00, v11, v01));
+        }
+    }
+}
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+}
+
+Model make_sphere(int subdivisions) {
+    const float t = (1.f + std::sqrt(5.f)) * 0.5f;
+    std::vector<Vec3f> vertices = {
+        {-1.f, t, 0.f}, {1.f, t, 0.f}, {-1.f, -t, 0.f}, {1.f, -t, 0.f},
+        {0.f, -1.f, t}, {0.f, 1.f, t}, {0.f, -1.f, -t}, {0.f, 1.f, -t},
+        {t, 0.f, -1.f}, {t, 0.f, 1.f}, {-t, 0.f, -1.f}, {-t, 0.f, 1.f},
+    };
+    for (auto& v : vertices) {
+        v = normalize(v);
+    }
+    std::vector<std::array<int, 3>> triangles = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1},
+    };
+
+    for (int level = 0; level < subdivisions; ++level) {
+        std::unordered_map<uint64_t, int> midpoints;
+        midpoints.reserve(triangles.size() * 2);
+        auto midpoint = [&](int a, int b) {
+            uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | static_cast<uint32_t>(std::max(a, b));
+            auto it = midpoints.find(key);
+            if (it != midpoints.end()) {
+                return it->second;
+            }
+            int id = static_cast<int>(vertices.size());
+            vertices.push_back(normalize((vertices[a] + vertices[b]) * 0.5f));
+            midpoints.emplace(key, id);
+            return id;
+        };
+        std::vector<std::array<int, 3>> refined;
+        refined.reserve(triangles.size() * 4);
+        for (const auto& tri : triangles) {
+            int ab = midpoint(tri[0], tri[1]);
+            int bc = midpoint(tri[1], tri[2]);
+            int ca = midpoint(tri[2], tri[0]);
+            refined.push_back({tri[0], ab, ca});
+            refined.push_back({tri[1], bc, ab});
+            refined.push_back({tri[2], ca, bc});
+            refined.push_back({ab, bc, ca});
+        }
+        triangles.swap(refined);
+    }
+
+    std::vector<Vec3f> normals = vertices;
+    std::vector<Model::Face> faces;
+    faces.reserve(triangles.size());
+    for (const auto& tri : triangles) {
+        Model::Face face;
+        face.vertex_ids = tri;
+        face.normal_ids = tri;
+        faces.push_back(face);
+    }
+    return Model(std::move(vertices), std::move(normals), std::move(faces));
+}
+
+Model make_terrain(int grid, float height_scale, uint32_t seed) {
+    grid = std::max(1, grid);
+    Random random(seed);
+    float phase_x = random.range(0.f, 6.2831853f);
+    float phase_z = random.range(0.f, 6.2831853f);
+    std::vector<Vec3f> vertices;
+    std::vector<Model::Face> faces;
+    add_grid(vertices, faces, grid, 0.f);
+    for (auto& v : vertices) {
+        float x = v.x;
+        float z = v.y;
+        float h = std::sin(x * 3.1f + phase_x) * std::cos(z * 2.7f + phase_z) * 0.6f +
+                  std::sin(x * 9.3f + z * 7.1f) * 0.25f +
+                  random.range(-0.05f, 0.05f);
+        v = {x, h * height_scale, z};
+    }
+    return Model(std::move(vertices), {}, std::move(faces));
+}
+
+Model make_instanced_grid(const Model& base, int count_x, int count_z, float spacing) {
+    std::vector<Vec3f> vertices;
+    std::vector<Vec3f> normals;
+    std::vector<Model::Face> faces;
+    std::vector<ModelObject> objects;
+    size_t instances = static_cast<size_t>(std::max(0, count_x)) * std::max(0, count_z);
+    vertices.reserve(base.vertex_count() * instances);
+    normals.reserve(base.normal_count() * instances);
+    faces.reserve(base.face_count() * instances);
+
+    float origin_x = -0.5f * spacing * static_cast<float>(count_x - 1);
+    float origin_z = -0.5f * spacing * static_cast<float>(count_z - 1);
+    for (int iz = 0; iz < count_z; ++iz) {
+        for (int ix = 0; ix < count_x; ++ix) {
+            Vec3f offset{origin_x + spacing * static_cast<float>(ix), 0.f, origin_z + spacing * static_cast<float>(iz)};
+            int vertex_base = static_cast<int>(vertices.size());
+            int normal_base = static_cast<int>(normals.size());
+            ModelObject& object = objects.emplace_back();
+            object.name = "instance" + std::to_string(objects.size() - 1);
+            object.first_face = faces.size();
+            object.face_count = base.face_count();
+            for (size_t i = 0; i < base.vertex_count(); ++i) {
+                vertices.push_back(base.vertex(static_cast<int>(i)) + offset);
+            }
+            for (size_t i = 0; i < base.normal_count(); ++i) {
+                normals.push_back(base.normal(static_cast<int>(i)));
+            }
+            for (size_t f = 0; f < base.face_count(); ++f) {
+                Model::Face face;
+                face.vertex_ids = base.face_vertex_indices(f);
+                face.normal_ids = base.face_normal_indices(f);
+                for (int k = 0; k < 3; ++k) {
+                    face.vertex_ids[k] += vertex_base;
+                    face.normal_ids[k] += normal_base;
+                }
+                faces.push_back(face);
+            }
+        }
+    }
+    return Model(std::move(vertices), std::move(normals), std::move(faces), std::move(objects));
+}
+
+Model make_slivers(size_t count, float aspect, uint32_t seed) {
+    Random random(seed);
+    std::vector<Vec3f> vertices;
+    std::vector<Model::Face> faces;
+    vertices.reserve(count * 3);
+    faces.reserve(count);
+    float length = 1.8f;
+    float width = length / std::max(1.f, aspect);
+    for (size_t i = 0; i < count; ++i) {
+        float angle = random.range(0.f, 3.14159265f);
+        Vec3f dir{std::cos(angle), std::sin(angle), 0.f};
+        Vec3f side{-dir.y, dir.x, 0.f};
+        Vec3f center{random.range(-0.1f, 0.1f), random.range(-0.1f, 0.1f), random.range(-0.5f, 0.5f)};
+        int id = static_cast<int>(vertices.size());
+        vertices.push_back(center - dir * (0.5f * length));
+        vertices.push_back(center + dir * (0.5f * length) - side * (0.5f * width));
+        vertices.push_back(center + dir * (0.5f * length) + side * (0.5f * width));
+        faces.push_back(make_face(id, id + 1, id + 2));
+    }
+    return Model(std::move(vertices), {}, std::move(faces));
+}
+
+Model make_stacked_planes(int layers, int grid, float spacing) {
+    std::vector<Vec3f> vertices;
+    std::vector<Model::Face> faces;
+    std::vector<ModelObject> objects;
+    grid = std::max(1, grid);
+    for (int layer = 0; layer < layers; ++layer) {
+        float z = -spacing * static_cast<float>(layers - 1 - layer);
+        size_t first = faces.size();
+        add_grid(vertices, faces, grid, z);
+        ModelObject& object = objects.emplace_back();
+        object.name = "layer" + std::to_string(layer);
+        object.first_face = first;
+        object.face_count = faces.size() - first;
+    }
+    return Model(std::move(vertices), {}, std::move(faces), std::move(objects));
+}
+
+Model make_triangle_field(size_t count, float size, uint32_t seed) {
+    Random random(seed);
+    std::vector<Vec3f> vertices;
+    std::vector<Model::Face> faces;
+    vertices.reserve(count * 3);
+    faces.reserve(count);
+    float radius = size / std::sqrt(3.f);
+    for (size_t i = 0; i < count; ++i) {
+        Vec3f center{random.range(-1.f, 1.f), random.range(-1.f, 1.f), random.range(-0.5f, 0.5f)};
+        float angle = random.range(0.f, 2.0943951f);
+        int id = static_cast<int>(vertices.size());
+        for (int k = 0; k < 3; ++k) {
+            float a = angle + 2.0943951f * static_cast<float>(k);
+            vertices.push_back(center + Vec3f{std::cos(a) * radius, std::sin(a) * radius, 0.f});
+        }
+        faces.push_back(make_face(id, id + 1, id + 2));
+    }
+    return Model(std::move(vertices), {}, std::move(faces));
+}
+
+Model make_synthetic(const std::string& spec) {
+    auto parts = split(spec, ':');
+    if (parts.empty()) {
+        throw std::runtime_error("Empty synthetic scene spec");
+    }
+    auto arg = [&](size_t index, const char* fallback) {
+        return index < parts.size() && !parts[index].empty() ? parts[index] : std::string(fallback);
+    };
+    const std::string& kind = parts[0];
+    if (kind == "sphere") {
+        return make_sphere(std::stoi(arg(1, "5")));
+    }
+    if (kind == "terrain") {
+        return make_terrain(std::stoi(arg(1, "256")));
+    }
+    if (kind == "grid") {
+        int count_x = std::stoi(arg(1, "10"));
+        int count_z = std::stoi(arg(2, arg(1, "10").c_str()));
+        return make_instanced_grid(make_sphere(std::stoi(arg(3, "3"))), count_x, count_z, 2.5f);
+    }
+    if (kind == "slivers") {
+        return make_slivers(std::stoul(arg(1, "10000")), std::stof(arg(2, "200")));
+    }
+    if (kind == "planes") {
+        return make_stacked_planes(std::stoi(arg(1, "16")), std::stoi(arg(2, "16")));
+    }
+    if (kind == "field") {
+        return make_triangle_field(std::stoul(arg(1, "100000")), std::stof(arg(2, "0.02")));
+    }
+    throw std::runtime_error("Unknown synthetic scene: " + spec);
+}
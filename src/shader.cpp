@@ -1,5 +1,20 @@
 #include "shader.hpp"
 
+#include "simd.hpp"
+
+void IShader::fragment_quad(const FragmentQuad& quad, ColorQuad& out) const {
+    for (int lane = 0; lane < FragmentQuad::kLanes; ++lane) {
+        if (quad.mask & (1u << lane)) {
+            const QuadVec3& p = quad.world_position;
+            const QuadVec3& n = quad.normal;
+            Vec3f color = fragment({{p.x[lane], p.y[lane], p.z[lane]}, {n.x[lane], n.y[lane], n.z[lane]}});
+            out.r[lane] = color.x;
+            out.g[lane] = color.y;
+            out.b[lane] = color.z;
+        }
+    }
+}
+
 void PhongShader::set_matrices(const Mat4f& model,
                                const Mat4f& view,
                                const Mat4f& projection) {
@@ -36,6 +51,10 @@ void PhongShader::set_material(const Vec3f& ambient,
     shininess_ = shininess;
 }
 
+void PhongShader::set_material(const Material& material) {
+    set_material(material.ambient, material.diffuse, material.specular, material.shininess);
+}
+
 void PhongShader::set_exposure(float exposure) {
     exposure_ = exposure;
 }
@@ -50,25 +69,9 @@ VertexOutput PhongShader::vertex(const VertexInput& in) {
     return out;
 }
 
-Vec3f PhongShader::fragment(const Vec3f& barycentric,
-                            const std::array<VertexOutput, 3>& data) const {
-    float w0 = barycentric.x * data[0].reciprocal_w;
-    float w1 = barycentric.y * data[1].reciprocal_w;
-    float w2 = barycentric.z * data[2].reciprocal_w;
-    float sum = w0 + w1 + w2;
-    if (sum == 0.f) {
-        return ambient_;
-    }
-    w0 /= sum;
-    w1 /= sum;
-    w2 /= sum;
-
-    Vec3f position = data[0].world_position * w0 +
-                     data[1].world_position * w1 +
-                     data[2].world_position * w2;
-    Vec3f normal = normalize(data[0].normal * w0 +
-                             data[1].normal * w1 +
-                             data[2].normal * w2);
+Vec3f PhongShader::fragment(const Fragment& in) const {
+    Vec3f position = in.world_position;
+    Vec3f normal = normalize(in.normal);
 
     Vec3f light_dir = normalize(-light_dir_);
     float diff = std::max(dot(normal, light_dir), 0.f);
@@ -90,3 +93,35 @@ Vec3f PhongShader::fragment(const Vec3f& barycentric,
 
     return keyed + fill_color;
 }
+
+void PhongShader::fragment_quad(const FragmentQuad& quad, ColorQuad& out) const {
+    const QuadVec3& p = quad.world_position;
+    const QuadVec3& n = quad.normal;
+    Vec3f4 position = {Float4::load(p.x), Float4::load(p.y), Float4::load(p.z)};
+    Vec3f4 normal = normalize(Vec3f4{Float4::load(n.x), Float4::load(n.y), Float4::load(n.z)});
+
+    Vec3f4 light_dir = splat(normalize(-light_dir_));
+    Float4 n_dot_l = dot(normal, light_dir);
+    Float4 diff = max(n_dot_l, 0.f);
+    Vec3f4 diffuse = splat(diffuse_) * diff;
+
+    Vec3f4 view_dir = normalize(splat(view_pos_) - position);
+    Vec3f4 reflect_dir = normalize(normal * (Float4(2.f) * n_dot_l) - light_dir);
+    Float4 spec = pow(max(dot(view_dir, reflect_dir), 0.f), shininess_);
+    Vec3f4 specular = splat(specular_) * spec;
+
+    Vec3f4 color = (splat(ambient_) + diffuse + specular) * exposure_;
+    Vec3f4 keyed = {color.x * light_color_.x, color.y * light_color_.y, color.z * light_color_.z};
+
+    Vec3f4 fill_color = splat({0.f, 0.f, 0.f});
+    if (length(fill_light_color_) > 0.f) {
+        Float4 fill_diff = max(dot(normal, splat(normalize(-fill_light_dir_))), 0.f);
+        Vec3f4 fill = splat(diffuse_) * fill_diff;
+        fill_color = {fill.x * fill_light_color_.x, fill.y * fill_light_color_.y, fill.z * fill_light_color_.z};
+    }
+
+    Vec3f4 result = keyed + fill_color;
+    result.x.store(out.r);
+    result.y.store(out.g);
+    result.z.store(out.b);
+}
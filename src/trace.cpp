@@ -0,0 +1,129 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+constexpr size_t kRingCapacity = size_t{1} << 16;
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int64_t arg;
+};
+
+struct ThreadBuffer {
+    int tid = 0;
+    std::string name;
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(kRingCapacity);
+    std::atomic<uint64_t> head{0};
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadBuffer& thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto created = std::make_shared<ThreadBuffer>();
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        created->tid = static_cast<int>(reg.buffers.size());
+        created->name = "thread " + std::to_string(created->tid);
+        reg.buffers.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+void write_escaped(std::ostream& out, const std::string& text) {
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            out << '\\';
+        }
+        out << ch;
+    }
+}
+}
+
+uint64_t Trace::now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - registry().epoch)
+                                     .count());
+}
+
+void Trace::record(const char* name, uint64_t start_ns, uint64_t end_ns, int64_t arg) {
+    ThreadBuffer& buffer = thread_buffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % kRingCapacity] = {name, start_ns, end_ns, arg};
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::set_thread_name(const std::string& name) {
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+bool Trace::write_chrome_json(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) {
+            out << ",\n";
+        }
+        first = false;
+    };
+    for (const auto& buffer : reg.buffers) {
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"";
+        write_escaped(out, buffer->name);
+        out << "\"}}";
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > kRingCapacity ? head - kRingCapacity : 0;
+        for (uint64_t i = begin; i < head; ++i) {
+            const TraceEvent& event = buffer->events[i % kRingCapacity];
+            separator();
+            out << "{\"name\":\"";
+            write_escaped(out, event.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << static_cast<double>(event.start_ns) / 1000.0
+                << ",\"dur\":" << static_cast<double>(event.end_ns - event.start_ns) / 1000.0;
+            if (event.arg >= 0) {
+                out << ",\"args\":{\"id\":" << event.arg << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "]}\n";
+    return static_cast<bool>(out);
+}
+
+void Trace::clear() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto& buffer : reg.buffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+}